@@ -0,0 +1,308 @@
+#include "baseline.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace bench {
+
+namespace {
+
+// MAD times this estimates the standard deviation of normally distributed samples
+constexpr double mad_to_sigma = 1.4826;
+
+// The subset of JSON the bench writes: objects, arrays, strings without escapes other than
+// \" and \\, numbers, true, false and null.
+struct Json
+{
+    enum class Type
+    {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object,
+    };
+    Type type = Type::null;
+    double number = 0;
+    std::string text;
+    std::vector<Json> items;
+    std::map<std::string, Json> fields;
+
+    const Json * field(const std::string & name) const
+    {
+        auto it = fields.find(name);
+        return it == fields.end() ? nullptr : &it->second;
+    }
+};
+
+class Parser
+{
+public:
+    explicit Parser(const std::string & text)
+        : m_text(text)
+    {
+    }
+
+    Json parse()
+    {
+        Json value = parseValue();
+        skipSpace();
+        if (m_pos != m_text.size()) {
+            fail("trailing characters");
+        }
+        return value;
+    }
+
+private:
+    const std::string & m_text;
+    std::size_t m_pos = 0;
+
+    [[noreturn]] void fail(const std::string & what) const
+    {
+        throw std::runtime_error(what + " at offset " + std::to_string(m_pos));
+    }
+
+    void skipSpace()
+    {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+            ++m_pos;
+        }
+    }
+
+    bool consume(char c)
+    {
+        skipSpace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+    }
+
+    bool consumeWord(const char * word)
+    {
+        std::size_t length = std::char_traits<char>::length(word);
+        if (m_text.compare(m_pos, length, word) == 0) {
+            m_pos += length;
+            return true;
+        }
+        return false;
+    }
+
+    std::string parseString()
+    {
+        expect('"');
+        std::string text;
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            if (m_text[m_pos] == '\\') {
+                ++m_pos;
+            }
+            if (m_pos < m_text.size()) {
+                text += m_text[m_pos++];
+            }
+        }
+        expect('"');
+        return text;
+    }
+
+    Json parseValue()
+    {
+        skipSpace();
+        Json value;
+        if (m_pos >= m_text.size()) {
+            fail("unexpected end");
+        }
+        char c = m_text[m_pos];
+        if (c == '{') {
+            value.type = Json::Type::object;
+            ++m_pos;
+            if (!consume('}')) {
+                do {
+                    std::string name = parseString();
+                    expect(':');
+                    value.fields[name] = parseValue();
+                } while (consume(','));
+                expect('}');
+            }
+        }
+        else if (c == '[') {
+            value.type = Json::Type::array;
+            ++m_pos;
+            if (!consume(']')) {
+                do {
+                    value.items.push_back(parseValue());
+                } while (consume(','));
+                expect(']');
+            }
+        }
+        else if (c == '"') {
+            value.type = Json::Type::string;
+            value.text = parseString();
+        }
+        else if (consumeWord("true")) {
+            value.type = Json::Type::boolean;
+            value.number = 1;
+        }
+        else if (consumeWord("false")) {
+            value.type = Json::Type::boolean;
+        }
+        else if (consumeWord("null")) {
+            value.type = Json::Type::null;
+        }
+        else {
+            std::size_t end = 0;
+            try {
+                value.number = std::stod(m_text.substr(m_pos, 32), &end);
+            }
+            catch (const std::exception &) {
+                fail("expected a value");
+            }
+            value.type = Json::Type::number;
+            m_pos += end;
+        }
+        return value;
+    }
+};
+
+double number(const Json & object, const std::string & name, double fallback)
+{
+    const Json * field = object.field(name);
+    return field != nullptr && field->type == Json::Type::number ? field->number : fallback;
+}
+
+std::string text(const Json & object, const std::string & name)
+{
+    const Json * field = object.field(name);
+    if (field == nullptr || field->type != Json::Type::string) {
+        throw std::runtime_error("result without \"" + name + "\"");
+    }
+    return field->text;
+}
+
+using Key = std::tuple<std::string, std::string, std::string>;
+
+Key keyOf(const Measurement & m)
+{
+    return {m.backend, m.dataset, m.operation};
+}
+
+// prints one comparison line, true if the metric regressed
+bool check(std::ostream & report, const Measurement & m, const char * metric, double before, double before_mad, double now, double now_mad, const Tolerance & tolerance)
+{
+    double change = before > 0 ? (now - before) / before : 0;
+    double noise = tolerance.mad_factor * mad_to_sigma * std::hypot(before_mad, now_mad);
+    bool regressed = change > tolerance.threshold && now - before > noise;
+    report << std::left << std::setw(12) << m.backend << std::setw(12) << m.dataset << std::setw(16) << m.operation << std::setw(14) << metric
+           << std::right << std::fixed << std::setprecision(1) << std::setw(14) << before << std::setw(14) << now << std::setw(9) << std::showpos
+           << change * 100 << "%" << std::noshowpos << std::defaultfloat << std::setprecision(6) << (regressed ? "  REGRESSION" : "") << "\n";
+    return regressed;
+}
+
+} // anonymous namespace
+
+double median(std::vector<double> values)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    auto middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    if (values.size() % 2 == 1) {
+        return *middle;
+    }
+    return (*middle + *std::max_element(values.begin(), middle)) / 2;
+}
+
+double mad(const std::vector<double> & values, double center)
+{
+    std::vector<double> deviations;
+    deviations.reserve(values.size());
+    for (double value : values) {
+        deviations.push_back(std::abs(value - center));
+    }
+    return median(std::move(deviations));
+}
+
+std::optional<std::vector<Measurement>> readBaseline(const std::string & filename, std::string & error)
+{
+    std::ifstream in(filename);
+    if (!in) {
+        error = "cannot open " + filename;
+        return std::nullopt;
+    }
+    std::stringstream content;
+    content << in.rdbuf();
+    std::string text_content = content.str();
+    try {
+        Json root = Parser(text_content).parse();
+        const Json * results = root.field("results");
+        if (results == nullptr || results->type != Json::Type::array) {
+            throw std::runtime_error("no \"results\" array");
+        }
+        std::vector<Measurement> measurements;
+        for (const Json & result : results->items) {
+            Measurement m;
+            m.backend = text(result, "backend");
+            m.dataset = text(result, "dataset");
+            m.operation = text(result, "operation");
+            m.ns_per_op = number(result, "ns_per_op", 0);
+            m.mad_ns_per_op = number(result, "mad_ns_per_op", 0);
+            m.peak_rss = number(result, "peak_rss_bytes", 0);
+            m.mad_peak_rss = number(result, "mad_peak_rss_bytes", 0);
+            if (result.field("memory_bytes") != nullptr) {
+                m.memory = number(result, "memory_bytes", 0);
+            }
+            measurements.push_back(std::move(m));
+        }
+        return measurements;
+    }
+    catch (const std::exception & e) {
+        error = filename + ": " + e.what();
+        return std::nullopt;
+    }
+}
+
+std::size_t compare(const std::vector<Measurement> & baseline, const std::vector<Measurement> & current, const Tolerance & tolerance, std::ostream & report)
+{
+    std::map<Key, const Measurement *> before;
+    for (const Measurement & m : baseline) {
+        before[keyOf(m)] = &m;
+    }
+    report << std::left << std::setw(12) << "backend" << std::setw(12) << "dataset" << std::setw(16) << "operation" << std::setw(14) << "metric"
+           << std::right << std::setw(14) << "baseline" << std::setw(14) << "current" << std::setw(10) << "change" << "\n";
+    std::size_t regressions = 0, compared = 0;
+    for (const Measurement & now : current) {
+        auto it = before.find(keyOf(now));
+        if (it == before.end()) {
+            continue;
+        }
+        const Measurement & then = *it->second;
+        ++compared;
+        regressions += check(report, now, "ns_per_op", then.ns_per_op, then.mad_ns_per_op, now.ns_per_op, now.mad_ns_per_op, tolerance);
+        if (now.operation == "build") {
+            regressions += check(report, now, "peak_rss", then.peak_rss, then.mad_peak_rss, now.peak_rss, now.mad_peak_rss, tolerance);
+            if (then.memory && now.memory) {
+                regressions += check(report, now, "memory", *then.memory, 0, *now.memory, 0, tolerance);
+            }
+        }
+    }
+    report << compared << " of " << current.size() << " results compared, " << regressions << " regression" << (regressions == 1 ? "" : "s") << "\n";
+    return regressions;
+}
+
+} // namespace bench
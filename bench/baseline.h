@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// One result of a bench run as a baseline stores it: medians over the trials and their spread.
+struct Measurement
+{
+    std::string backend;
+    std::string dataset;
+    std::string operation;
+    double ns_per_op = 0;
+    // median absolute deviation of ns_per_op over the trials
+    double mad_ns_per_op = 0;
+    double peak_rss = 0;
+    double mad_peak_rss = 0;
+    // heap bytes the set reports through memoryUsage(), for the backends that have it
+    std::optional<double> memory;
+};
+
+struct Tolerance
+{
+    // a metric regresses when it grows by more than this share of the baseline value...
+    double threshold = 0.10;
+    // ...and by more than this many standard deviations, estimated from the MADs of both runs
+    double mad_factor = 3;
+};
+
+double median(std::vector<double> values);
+// median absolute deviation from `center`
+double mad(const std::vector<double> & values, double center);
+
+// the "results" of a JSON file the bench wrote, nullopt with `error` set if it cannot be read
+std::optional<std::vector<Measurement>> readBaseline(const std::string & filename, std::string & error);
+
+// Compares the time, peak RSS and reported memory of every result present in both runs,
+// printing one line per metric to `report`. Returns the number of regressions.
+std::size_t compare(const std::vector<Measurement> & baseline, const std::vector<Measurement> & current, const Tolerance & tolerance, std::ostream & report);
+
+} // namespace bench
@@ -0,0 +1,530 @@
+#include "adaptive.h"
+#include "baseline.h"
+#include "counters.h"
+#include "delaunay.h"
+#include "generators.h"
+#include "grid.h"
+#include "learned.h"
+#include "primitives.h"
+#include "quadtree.h"
+#include "resources.h"
+#include "rtree.h"
+#include "trace.h"
+#include "vptree.h"
+#include "zorder.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// operations between two checks of the time budget
+constexpr std::size_t budget_check_interval = 64;
+
+struct Options
+{
+    std::size_t n = 100000;
+    std::size_t queries = 10000;
+    std::size_t k = 10;
+    std::uint64_t seed = 42;
+    // wall time one operation kind may take on one backend before it is cut short
+    std::chrono::milliseconds budget{2000};
+    std::vector<bench::Distribution> datasets = bench::distributions();
+    // empty runs every backend
+    std::vector<std::string> backends;
+    // range query area as a share of the bounding box area of the data
+    std::vector<double> selectivities = {0.0001, 0.001, 0.01};
+    std::string output;
+    // every backend runs this many times per dataset; results report the median and MAD
+    std::size_t trials = 1;
+    // also write the results here, for later runs to --compare against
+    std::string save_baseline;
+    // results file of an earlier run; regressions against it make the exit status 2
+    std::string compare;
+    bench::Tolerance tolerance;
+    // Chrome trace-event file of the kd-tree events, written when built with KDTREE_TRACE
+    std::string trace;
+};
+
+// queries derived from one dataset, the same for every backend
+struct Workload
+{
+    bench::Distribution distribution;
+    std::vector<Point> points;
+    // new points for put(), drawn from the same distribution
+    std::vector<Point> puts;
+    // alternately a stored point and a point next to one
+    std::vector<Point> lookups;
+    // stored points moved by about the typical point spacing
+    std::vector<Point> near;
+    // one query window list per selectivity
+    std::vector<std::vector<Rect>> windows;
+};
+
+struct Record
+{
+    std::string backend;
+    std::string dataset;
+    std::string operation;
+    std::size_t ops = 0;
+    double seconds = 0;
+    std::size_t results = 0;
+    std::size_t peak_rss = 0;
+    // hardware counter totals over the `ops` operations, for the counters that are available
+    bench::CounterValues counters;
+    // bytes the set reports through memoryUsage() after the build, for backends that have it
+    std::optional<std::size_t> memory;
+};
+
+// the records of one backend, dataset and operation over all trials
+struct Result
+{
+    // medians and MADs
+    bench::Measurement measurement;
+    std::vector<double> trial_ns_per_op;
+    std::size_t ops = 0;
+    double results_per_op = 0;
+    // medians over the trials of the per operation counts
+    bench::CounterValues counters;
+};
+
+Workload makeWorkload(bench::Distribution distribution, const Options & options)
+{
+    Workload workload{distribution, bench::generate(distribution, options.n + options.queries, options.seed), {}, {}, {}, {}};
+    workload.puts.assign(workload.points.begin() + options.n, workload.points.end());
+    workload.points.erase(workload.points.begin() + options.n, workload.points.end());
+    if (workload.points.empty()) {
+        return workload;
+    }
+
+    auto [xmin, xmax] = std::minmax_element(workload.points.begin(), workload.points.end(), [](const Point & lhs, const Point & rhs) { return lhs.x() < rhs.x(); });
+    auto [ymin, ymax] = std::minmax_element(workload.points.begin(), workload.points.end(), [](const Point & lhs, const Point & rhs) { return lhs.y() < rhs.y(); });
+    double width = std::max(1.0, xmax->x() - xmin->x());
+    double height = std::max(1.0, ymax->y() - ymin->y());
+    double spacing = std::sqrt(width * height / workload.points.size());
+
+    std::mt19937_64 gen(options.seed + 1);
+    std::normal_distribution<double> jitter(0, spacing);
+    auto stored = [&]() -> const Point & { return workload.points[gen() % workload.points.size()]; };
+    for (std::size_t i = 0; i < options.queries; ++i) {
+        const Point & p = stored();
+        workload.lookups.push_back(i % 2 == 0 ? p : Point(p.x() + spacing / 3, p.y()));
+        const Point & q = stored();
+        workload.near.emplace_back(q.x() + jitter(gen), q.y() + jitter(gen));
+    }
+    for (double selectivity : options.selectivities) {
+        double half = std::sqrt(selectivity * width * height) / 2;
+        auto & windows = workload.windows.emplace_back();
+        for (std::size_t i = 0; i < options.queries; ++i) {
+            const Point & c = stored();
+            windows.emplace_back(Point(c.x() - half, c.y() - half), Point(c.x() + half, c.y() + half));
+        }
+    }
+    return workload;
+}
+
+template <typename PointSet>
+void build(std::optional<PointSet> & set, const std::vector<Point> & points)
+{
+    set.emplace(points);
+}
+
+template <>
+void build(std::optional<rbtree::PointSet> & set, const std::vector<Point> & points)
+{
+    set.emplace(std::set<Point>(points.begin(), points.end()));
+}
+
+class Runner
+{
+public:
+    explicit Runner(const Options & options)
+        : m_options(options)
+    {
+        if (!m_counters.any()) {
+            std::cerr << "hardware counters unavailable (" << m_counters.error() << "), reporting times only" << std::endl;
+        }
+    }
+
+    template <typename PointSet>
+    void run(const char * backend, const Workload & workload)
+    {
+        bench::resetPeakRss();
+        std::optional<PointSet> set;
+        // build is timed once and reported per input point
+        m_counters.start();
+        auto start = Clock::now();
+        build(set, workload.points);
+        auto elapsed = Clock::now() - start;
+        record(backend, workload, "build", workload.points.size(), elapsed, set->size(), m_counters.stop());
+        if constexpr (requires { set->memoryUsage(); }) {
+            m_records.back().memory = set->memoryUsage().total();
+        }
+
+        measure(backend, workload, "contains", workload.lookups.size(), [&](std::size_t i) -> std::size_t {
+            return set->contains(workload.lookups[i]);
+        });
+        measure(backend, workload, "nearest", workload.near.size(), [&](std::size_t i) -> std::size_t {
+            return set->nearest(workload.near[i]).has_value();
+        });
+        measure(backend, workload, "knn", workload.near.size(), [&](std::size_t i) -> std::size_t {
+            return set->nearest(workload.near[i], m_options.k).size();
+        });
+        for (std::size_t s = 0; s < workload.windows.size(); ++s) {
+            std::ostringstream operation;
+            operation << "range_" << m_options.selectivities[s];
+            const auto & windows = workload.windows[s];
+            measure(backend, workload, operation.str(), windows.size(), [&](std::size_t i) -> std::size_t {
+                return set->range(windows[i]).size();
+            });
+        }
+        // last, because it changes the set the other operations run on
+        measure(backend, workload, "put", workload.puts.size(), [&](std::size_t i) -> std::size_t {
+            set->put(workload.puts[i]);
+            return 0;
+        });
+    }
+
+    const std::vector<Record> & records() const
+    {
+        return m_records;
+    }
+
+private:
+    const Options & m_options;
+    std::vector<Record> m_records;
+    bench::Counters m_counters;
+
+    // runs op(0), op(1), ... until `count` operations are done or the budget is spent;
+    // op returns the size of its result
+    template <typename Op>
+    void measure(const char * backend, const Workload & workload, const std::string & operation, std::size_t count, Op && op)
+    {
+        std::size_t done = 0, results = 0;
+        m_counters.start();
+        auto start = Clock::now();
+        auto deadline = start + m_options.budget;
+        while (done < count) {
+            results += op(done++);
+            if (done % budget_check_interval == 0 && Clock::now() > deadline) {
+                break;
+            }
+        }
+        auto elapsed = Clock::now() - start;
+        record(backend, workload, operation, done, elapsed, results, m_counters.stop());
+    }
+
+    void record(const char * backend, const Workload & workload, const std::string & operation, std::size_t ops, Clock::duration elapsed, std::size_t results, const bench::CounterValues & counters)
+    {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        m_records.push_back({backend, bench::name(workload.distribution), operation, ops, seconds, results, bench::peakRss(), counters});
+        std::cerr << backend << " " << bench::name(workload.distribution) << " " << operation << ": "
+                  << (ops == 0 ? 0 : seconds * 1e9 / ops) << " ns/op";
+        for (std::size_t c = 0; c < bench::counter_count; ++c) {
+            if (counters[c] && ops > 0) {
+                std::cerr << ", " << *counters[c] / ops << " " << bench::name(static_cast<bench::Counter>(c));
+            }
+        }
+        std::cerr << std::endl;
+    }
+};
+
+using Run = void (Runner::*)(const char *, const Workload &);
+
+const std::vector<std::pair<const char *, Run>> & backends()
+{
+    static const std::vector<std::pair<const char *, Run>> all = {
+            {"rb_tree", &Runner::run<rbtree::PointSet>},
+            {"kd_tree", &Runner::run<kdtree::PointSet>},
+            {"grid", &Runner::run<grid::PointSet>},
+            {"r_tree", &Runner::run<rtree::PointSet>},
+            {"quad_tree", &Runner::run<quadtree::PointSet>},
+            {"z_order", &Runner::run<zorder::PointSet<>>},
+            {"learned", &Runner::run<learned::PointSet>},
+            {"vp_tree", &Runner::run<vptree::PointSet<>>},
+            {"delaunay", &Runner::run<delaunay::PointSet>},
+            {"adaptive", &Runner::run<adaptive::PointSet>},
+    };
+    return all;
+}
+
+std::vector<Result> summarize(const std::vector<Record> & records)
+{
+    std::vector<Result> results;
+    std::vector<std::vector<const Record *>> trials;
+    for (const Record & r : records) {
+        auto same = [&r](const Result & result) {
+            const auto & m = result.measurement;
+            return m.backend == r.backend && m.dataset == r.dataset && m.operation == r.operation;
+        };
+        auto it = std::find_if(results.begin(), results.end(), same);
+        if (it == results.end()) {
+            it = results.insert(results.end(), Result{{r.backend, r.dataset, r.operation}, {}, 0, 0, {}});
+            trials.emplace_back();
+        }
+        trials[it - results.begin()].push_back(&r);
+    }
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        Result & result = results[i];
+        bench::Measurement & m = result.measurement;
+        std::vector<double> rss, results_per_op;
+        std::array<std::vector<double>, bench::counter_count> counters;
+        for (const Record * r : trials[i]) {
+            result.trial_ns_per_op.push_back(r->ops == 0 ? 0 : r->seconds * 1e9 / r->ops);
+            rss.push_back(static_cast<double>(r->peak_rss));
+            results_per_op.push_back(r->ops == 0 ? 0 : static_cast<double>(r->results) / r->ops);
+            for (std::size_t c = 0; c < bench::counter_count; ++c) {
+                if (r->counters[c] && r->ops > 0) {
+                    counters[c].push_back(*r->counters[c] / r->ops);
+                }
+            }
+            result.ops = std::max(result.ops, r->ops);
+            if (r->memory) {
+                m.memory = static_cast<double>(*r->memory);
+            }
+        }
+        m.ns_per_op = bench::median(result.trial_ns_per_op);
+        m.mad_ns_per_op = bench::mad(result.trial_ns_per_op, m.ns_per_op);
+        m.peak_rss = bench::median(rss);
+        m.mad_peak_rss = bench::mad(rss, m.peak_rss);
+        result.results_per_op = bench::median(results_per_op);
+        for (std::size_t c = 0; c < bench::counter_count; ++c) {
+            if (!counters[c].empty()) {
+                result.counters[c] = bench::median(counters[c]);
+            }
+        }
+    }
+    return results;
+}
+
+void writeJson(std::ostream & out, const Options & options, const std::vector<Result> & results)
+{
+    out << "{\n"
+        << "  \"n\": " << options.n << ",\n"
+        << "  \"queries\": " << options.queries << ",\n"
+        << "  \"k\": " << options.k << ",\n"
+        << "  \"seed\": " << options.seed << ",\n"
+        << "  \"budget_ms\": " << options.budget.count() << ",\n"
+        << "  \"trials\": " << options.trials << ",\n"
+        << "  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result & r = results[i];
+        const bench::Measurement & m = r.measurement;
+        double ops_per_second = m.ns_per_op > 0 ? 1e9 / m.ns_per_op : 0;
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"backend\": \"" << m.backend << "\", \"dataset\": \"" << m.dataset << "\", \"operation\": \"" << m.operation
+            << "\", \"ops\": " << r.ops << ", \"ns_per_op\": " << m.ns_per_op << ", \"mad_ns_per_op\": " << m.mad_ns_per_op
+            << ", \"trial_ns_per_op\": [";
+        for (std::size_t t = 0; t < r.trial_ns_per_op.size(); ++t) {
+            out << (t == 0 ? "" : ", ") << r.trial_ns_per_op[t];
+        }
+        out << "], \"ops_per_second\": " << ops_per_second << ", \"results_per_op\": " << r.results_per_op
+            << ", \"peak_rss_bytes\": " << static_cast<std::size_t>(m.peak_rss) << ", \"mad_peak_rss_bytes\": " << static_cast<std::size_t>(m.mad_peak_rss);
+        if (m.memory) {
+            out << ", \"memory_bytes\": " << static_cast<std::size_t>(*m.memory);
+        }
+        // per operation, and only the counters that could be read
+        bool first = true;
+        for (std::size_t c = 0; c < bench::counter_count; ++c) {
+            if (r.counters[c]) {
+                out << (first ? ", \"counters\": {" : ", ") << "\"" << bench::name(static_cast<bench::Counter>(c)) << "\": " << *r.counters[c];
+                first = false;
+            }
+        }
+        out << (first ? "}" : "}}");
+    }
+    out << "\n  ]\n}\n";
+}
+
+std::vector<std::string> split(const std::string & list)
+{
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    for (std::string item; std::getline(in, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+void usage(const char * program)
+{
+    std::cerr << "usage: " << program << " [--n N] [--queries Q] [--k K] [--seed S] [--budget-ms MS]\n"
+              << "       [--datasets uniform,clustered,line,road,duplicates,sorted] [--backends name,...]\n"
+              << "       [--selectivities 0.0001,0.001,0.01] [--output results.json]\n"
+              << "       [--trace kdtree.trace.json] [--trials T] [--save-baseline baseline.json]\n"
+              << "       [--compare baseline.json] [--threshold 0.10] [--mad-factor 3]\n"
+              << "build is reported per input point, every other operation per call, and so are the\n"
+              << "hardware counters (cycles, instructions, cache, branch and dTLB misses) when readable;\n"
+              << "times are medians over the trials, and with --compare the exit status is 2 when a time,\n"
+              << "peak RSS or memoryUsage() grew by more than the threshold and by more than mad-factor\n"
+              << "standard deviations (estimated from the MADs of both runs)\n";
+}
+
+bool parse(int argc, char ** argv, Options & options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (flag == "--n") {
+            options.n = std::stoull(value);
+        }
+        else if (flag == "--queries") {
+            options.queries = std::stoull(value);
+        }
+        else if (flag == "--k") {
+            options.k = std::stoull(value);
+        }
+        else if (flag == "--seed") {
+            options.seed = std::stoull(value);
+        }
+        else if (flag == "--budget-ms") {
+            options.budget = std::chrono::milliseconds(std::stoll(value));
+        }
+        else if (flag == "--datasets") {
+            options.datasets.clear();
+            for (const auto & name : split(value)) {
+                auto distribution = bench::parseDistribution(name);
+                if (!distribution) {
+                    std::cerr << "unknown dataset " << name << "\n";
+                    return false;
+                }
+                options.datasets.push_back(*distribution);
+            }
+        }
+        else if (flag == "--backends") {
+            options.backends = split(value);
+            for (const auto & name : options.backends) {
+                if (std::none_of(backends().begin(), backends().end(), [&name](const auto & backend) { return name == backend.first; })) {
+                    std::cerr << "unknown backend " << name << "\n";
+                    return false;
+                }
+            }
+        }
+        else if (flag == "--selectivities") {
+            options.selectivities.clear();
+            for (const auto & item : split(value)) {
+                options.selectivities.push_back(std::stod(item));
+            }
+        }
+        else if (flag == "--output") {
+            options.output = value;
+        }
+        else if (flag == "--trace") {
+            options.trace = value;
+        }
+        else if (flag == "--trials") {
+            options.trials = std::stoull(value);
+        }
+        else if (flag == "--save-baseline") {
+            options.save_baseline = value;
+        }
+        else if (flag == "--compare") {
+            options.compare = value;
+        }
+        else if (flag == "--threshold") {
+            options.tolerance.threshold = std::stod(value);
+        }
+        else if (flag == "--mad-factor") {
+            options.tolerance.mad_factor = std::stod(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return options.trials > 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    try {
+        if (!parse(argc, argv, options)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::optional<std::vector<bench::Measurement>> baseline;
+    if (!options.compare.empty()) {
+        std::string error;
+        baseline = bench::readBaseline(options.compare, error);
+        if (!baseline) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+
+#ifndef KDTREE_TRACE
+    if (!options.trace.empty()) {
+        std::cerr << "--trace needs a build with -DKDTREE_TRACE=ON, no events are recorded\n";
+    }
+#endif
+
+    Runner runner(options);
+    for (auto distribution : options.datasets) {
+        Workload workload = makeWorkload(distribution, options);
+        // trials outermost, so that drift of the machine spreads over all backends alike
+        for (std::size_t trial = 0; trial < options.trials; ++trial) {
+            for (const auto & [name, run] : backends()) {
+                if (options.backends.empty() || std::find(options.backends.begin(), options.backends.end(), name) != options.backends.end()) {
+                    (runner.*run)(name, workload);
+                }
+            }
+        }
+    }
+
+    std::vector<Result> results = summarize(runner.records());
+    if (options.output.empty()) {
+        writeJson(std::cout, options, results);
+    }
+    else {
+        std::ofstream out(options.output);
+        writeJson(out, options, results);
+    }
+    if (!options.save_baseline.empty()) {
+        std::ofstream out(options.save_baseline);
+        writeJson(out, options, results);
+        if (!out) {
+            std::cerr << "cannot write " << options.save_baseline << "\n";
+            return 1;
+        }
+    }
+    if (!options.trace.empty() && !trace::ChromeTrace::write(options.trace)) {
+        std::cerr << "cannot write " << options.trace << "\n";
+        return 1;
+    }
+    if (baseline) {
+        std::vector<bench::Measurement> current;
+        for (const Result & result : results) {
+            current.push_back(result.measurement);
+        }
+        if (bench::compare(*baseline, current, options.tolerance, std::cerr) > 0) {
+            return 2;
+        }
+    }
+    return 0;
+}
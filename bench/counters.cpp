@@ -0,0 +1,151 @@
+#include "counters.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench {
+
+namespace {
+
+#ifdef __linux__
+
+constexpr std::uint64_t cacheMiss(std::uint64_t cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// (type, config) of every Counter, in enum order
+constexpr std::pair<std::uint32_t, std::uint64_t> events[counter_count] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D)},
+        {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+int openEvent(std::uint32_t type, std::uint64_t config)
+{
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    // leaving out the kernel keeps the counters usable at perf_event_paranoid 2
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+#endif
+
+} // anonymous namespace
+
+const char * name(Counter counter)
+{
+    switch (counter) {
+    case Counter::cycles:
+        return "cycles";
+    case Counter::instructions:
+        return "instructions";
+    case Counter::l1d_misses:
+        return "l1d_misses";
+    case Counter::llc_misses:
+        return "llc_misses";
+    case Counter::branch_misses:
+        return "branch_misses";
+    case Counter::dtlb_misses:
+        return "dtlb_misses";
+    }
+    return "unknown";
+}
+
+Counters::Counters()
+{
+    m_fds.fill(-1);
+#ifdef __linux__
+    for (std::size_t i = 0; i < counter_count; ++i) {
+        m_fds[i] = openEvent(events[i].first, events[i].second);
+        if (m_fds[i] < 0 && m_error.empty()) {
+            m_error = std::string(name(static_cast<Counter>(i))) + ": " + std::strerror(errno);
+        }
+    }
+#else
+    m_error = "perf_event_open is Linux only";
+#endif
+}
+
+Counters::~Counters()
+{
+#ifdef __linux__
+    for (int fd : m_fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool Counters::available(Counter counter) const
+{
+    return m_fds[static_cast<std::size_t>(counter)] >= 0;
+}
+
+bool Counters::any() const
+{
+    for (int fd : m_fds) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string & Counters::error() const
+{
+    return m_error;
+}
+
+void Counters::start()
+{
+#ifdef __linux__
+    for (int fd : m_fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+CounterValues Counters::stop()
+{
+    CounterValues values;
+#ifdef __linux__
+    for (int fd : m_fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (std::size_t i = 0; i < counter_count; ++i) {
+        // value, time enabled, time running
+        std::uint64_t data[3] = {};
+        if (m_fds[i] < 0 || read(m_fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            continue;
+        }
+        values[i] = static_cast<double>(data[0]) * data[1] / data[2];
+    }
+#endif
+    return values;
+}
+
+} // namespace bench
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string>
+
+namespace bench {
+
+enum class Counter
+{
+    cycles,
+    instructions,
+    // L1 data cache read misses
+    l1d_misses,
+    // last level cache read misses
+    llc_misses,
+    branch_misses,
+    // data TLB read misses
+    dtlb_misses,
+};
+
+constexpr std::size_t counter_count = 6;
+
+const char * name(Counter counter);
+
+using CounterValues = std::array<std::optional<double>, counter_count>;
+
+// Hardware counters of the calling thread, user space only, read through perf_event_open.
+// Each counter is opened on its own, so one the CPU, the kernel or the permissions do not
+// allow is simply missing; without any, start() and stop() do nothing and stop() returns no
+// values.
+class Counters
+{
+public:
+    Counters();
+    ~Counters();
+    Counters(const Counters &) = delete;
+    Counters & operator=(const Counters &) = delete;
+
+    bool available(Counter counter) const;
+    bool any() const;
+    // why the first unavailable counter could not be opened, empty if all are available
+    const std::string & error() const;
+
+    void start();
+    // counts since start(), scaled up when the kernel had to multiplex the counters
+    CounterValues stop();
+
+private:
+    std::array<int, counter_count> m_fds;
+    std::string m_error;
+};
+
+} // namespace bench
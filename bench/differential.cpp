@@ -0,0 +1,758 @@
+#include "adaptive.h"
+#include "cache.h"
+#include "delaunay.h"
+#include "generators.h"
+#include "grid.h"
+#include "learned.h"
+#include "primitives.h"
+#include "quadtree.h"
+#include "rtree.h"
+#include "vptree.h"
+#include "zorder.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Kind
+{
+    put,
+    contains,
+    nearest,
+    knn,
+    range,
+};
+
+constexpr std::size_t kind_count = 5;
+
+const char * name(Kind kind)
+{
+    switch (kind) {
+    case Kind::put:
+        return "put";
+    case Kind::contains:
+        return "contains";
+    case Kind::nearest:
+        return "nearest";
+    case Kind::knn:
+        return "knn";
+    case Kind::range:
+        return "range";
+    }
+    return "unknown";
+}
+
+std::optional<Kind> parseKind(const std::string & value)
+{
+    for (std::size_t i = 0; i < kind_count; ++i) {
+        if (value == name(static_cast<Kind>(i))) {
+            return static_cast<Kind>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+struct Operation
+{
+    Kind kind;
+    // the point of put, contains and the nearest queries, the left bottom corner of a range
+    Point p;
+    // the right top corner of a range
+    Point q = {0, 0};
+    std::size_t k = 0;
+};
+
+// a starting point list and the operations run on the set built from it
+struct Case
+{
+    std::vector<Point> points;
+    std::vector<Operation> operations;
+};
+
+struct Options
+{
+    std::size_t cases = 2000;
+    std::size_t operations = 500;
+    std::size_t max_points = 1000;
+    std::uint64_t seed = 42;
+    // empty runs every backend
+    std::vector<std::string> backends;
+    // a backend slower than the brute-force oracle by more than this factor on some operation
+    // fails; 0 only reports the timings
+    double max_slowdown = 0;
+    // runs this reproducer instead of random cases
+    std::string replay;
+};
+
+// time spent per operation kind, by a backend and by the oracle on the same operations
+struct Timings
+{
+    std::array<std::size_t, kind_count> ops{};
+    std::array<Clock::duration, kind_count> backend{};
+    std::array<Clock::duration, kind_count> oracle{};
+};
+
+// the first operation whose result differs from the oracle's; `operation` equals the number of
+// operations when the set was already wrong after construction or is wrong after the last one
+struct Failure
+{
+    std::size_t operation;
+    std::string message;
+};
+
+bool lexicographic(const Point & lhs, const Point & rhs)
+{
+    return lhs.x() < rhs.x() || (lhs.x() == rhs.x() && lhs.y() < rhs.y());
+}
+
+// Brute-force point set every backend is checked against.
+class Oracle
+{
+public:
+    explicit Oracle(const std::vector<Point> & points)
+    {
+        for (const auto & p : points) {
+            put(p);
+        }
+    }
+
+    std::size_t size() const
+    {
+        return m_points.size();
+    }
+
+    void put(const Point & p)
+    {
+        if (!contains(p)) {
+            m_points.push_back(p);
+        }
+    }
+
+    bool contains(const Point & p) const
+    {
+        return std::find(m_points.begin(), m_points.end(), p) != m_points.end();
+    }
+
+    // squared distances of the k nearest points, ascending
+    std::vector<double> nearest(const Point & p, std::size_t k) const
+    {
+        std::vector<double> distances;
+        distances.reserve(m_points.size());
+        for (const auto & point : m_points) {
+            distances.push_back(squaredDistance(point, p));
+        }
+        k = std::min(k, distances.size());
+        std::partial_sort(distances.begin(), distances.begin() + k, distances.end());
+        distances.resize(k);
+        return distances;
+    }
+
+    std::vector<Point> range(const Rect & rect) const
+    {
+        std::vector<Point> in_rect;
+        std::copy_if(m_points.begin(), m_points.end(), std::back_inserter(in_rect), [&rect](const Point & p) { return rect.contains(p); });
+        std::sort(in_rect.begin(), in_rect.end(), lexicographic);
+        return in_rect;
+    }
+
+    std::vector<Point> sorted() const
+    {
+        std::vector<Point> points = m_points;
+        std::sort(points.begin(), points.end(), lexicographic);
+        return points;
+    }
+
+private:
+    std::vector<Point> m_points;
+};
+
+std::string describe(const Point & p)
+{
+    std::ostringstream out;
+    out << std::setprecision(17) << "(" << p.x() << ", " << p.y() << ")";
+    return out.str();
+}
+
+// distances of different points that tie exactly may round apart in the last bits
+bool sameDistance(double lhs, double rhs)
+{
+    return std::abs(lhs - rhs) <= 1e-12 * std::max(1.0, std::max(lhs, rhs));
+}
+
+// empty when `points` are distinct members of the oracle whose distances to p are `expected`
+template <typename Points>
+std::string compareNeighbours(const Oracle & oracle, const Point & p, const Points & points, const std::vector<double> & expected)
+{
+    std::vector<double> distances;
+    std::vector<Point> seen;
+    for (const Point & point : points) {
+        if (!oracle.contains(point)) {
+            return "returned " + describe(point) + ", which is not in the set";
+        }
+        if (std::find(seen.begin(), seen.end(), point) != seen.end()) {
+            return "returned " + describe(point) + " twice";
+        }
+        seen.push_back(point);
+        distances.push_back(squaredDistance(point, p));
+    }
+    std::sort(distances.begin(), distances.end());
+    if (distances.size() != expected.size()) {
+        return "returned " + std::to_string(distances.size()) + " points instead of " + std::to_string(expected.size());
+    }
+    for (std::size_t i = 0; i < distances.size(); ++i) {
+        if (!sameDistance(distances[i], expected[i])) {
+            std::ostringstream out;
+            out << std::setprecision(17) << "neighbour " << i << " is at squared distance " << distances[i] << " instead of " << expected[i];
+            return out.str();
+        }
+    }
+    return {};
+}
+
+template <typename Points>
+std::string compareSets(const Points & points, const std::vector<Point> & expected)
+{
+    std::vector<Point> sorted(std::begin(points), std::end(points));
+    std::sort(sorted.begin(), sorted.end(), lexicographic);
+    if (sorted.size() != expected.size()) {
+        return "returned " + std::to_string(sorted.size()) + " points instead of " + std::to_string(expected.size());
+    }
+    auto mismatch = std::mismatch(sorted.begin(), sorted.end(), expected.begin());
+    if (mismatch.first != sorted.end()) {
+        return "returned " + describe(*mismatch.first) + " where " + describe(*mismatch.second) + " was expected";
+    }
+    return {};
+}
+
+template <typename PointSet>
+void build(std::optional<PointSet> & set, const std::vector<Point> & points)
+{
+    set.emplace(points);
+}
+
+template <>
+void build(std::optional<rbtree::PointSet> & set, const std::vector<Point> & points)
+{
+    set.emplace(std::set<Point>(points.begin(), points.end()));
+}
+
+// runs `c` on PointSet and on the oracle side by side, adding the time of every operation to
+// `timings` when given
+template <typename PointSet>
+std::optional<Failure> check(const Case & c, Timings * timings)
+{
+    std::optional<PointSet> set;
+    build(set, c.points);
+    Oracle oracle(c.points);
+    if (set->size() != oracle.size()) {
+        return Failure{c.operations.size(), "size " + std::to_string(set->size()) + " after construction instead of " + std::to_string(oracle.size())};
+    }
+
+    for (std::size_t i = 0; i < c.operations.size(); ++i) {
+        const Operation & op = c.operations[i];
+        auto kind = static_cast<std::size_t>(op.kind);
+        std::string error;
+        Clock::time_point start, middle;
+        switch (op.kind) {
+        case Kind::put: {
+            start = Clock::now();
+            set->put(op.p);
+            middle = Clock::now();
+            oracle.put(op.p);
+            if (set->size() != oracle.size()) {
+                error = "size " + std::to_string(set->size()) + " instead of " + std::to_string(oracle.size());
+            }
+            break;
+        }
+        case Kind::contains: {
+            start = Clock::now();
+            bool found = set->contains(op.p);
+            middle = Clock::now();
+            if (found != oracle.contains(op.p)) {
+                error = found ? "found a point that is not in the set" : "missed a point of the set";
+            }
+            break;
+        }
+        case Kind::nearest: {
+            start = Clock::now();
+            std::optional<Point> nearest = set->nearest(op.p);
+            middle = Clock::now();
+            std::vector<Point> result;
+            if (nearest) {
+                result.push_back(*nearest);
+            }
+            error = compareNeighbours(oracle, op.p, result, oracle.nearest(op.p, 1));
+            break;
+        }
+        case Kind::knn: {
+            start = Clock::now();
+            PointView neighbours = set->nearest(op.p, op.k);
+            middle = Clock::now();
+            error = compareNeighbours(oracle, op.p, neighbours, oracle.nearest(op.p, op.k));
+            break;
+        }
+        case Kind::range: {
+            Rect rect(op.p, op.q);
+            start = Clock::now();
+            PointView in_rect = set->range(rect);
+            middle = Clock::now();
+            error = compareSets(in_rect, oracle.range(rect));
+            break;
+        }
+        }
+        if (timings != nullptr) {
+            ++timings->ops[kind];
+            timings->backend[kind] += middle - start;
+            timings->oracle[kind] += Clock::now() - middle;
+        }
+        if (!error.empty()) {
+            return Failure{i, std::string(name(op.kind)) + " " + error};
+        }
+    }
+
+    if (std::string error = compareSets(*set, oracle.sorted()); !error.empty()) {
+        return Failure{c.operations.size(), "iteration " + error};
+    }
+    return std::nullopt;
+}
+
+using Check = std::optional<Failure> (*)(const Case &, Timings *);
+
+const std::vector<std::pair<const char *, Check>> & backends()
+{
+    static const std::vector<std::pair<const char *, Check>> all = {
+            {"rb_tree", &check<rbtree::PointSet>},
+            {"kd_tree", &check<kdtree::PointSet>},
+            {"grid", &check<grid::PointSet>},
+            {"r_tree", &check<rtree::PointSet>},
+            {"quad_tree", &check<quadtree::PointSet>},
+            {"z_order", &check<zorder::PointSet<>>},
+            {"learned", &check<learned::PointSet>},
+            {"vp_tree", &check<vptree::PointSet<>>},
+            {"delaunay", &check<delaunay::PointSet>},
+            {"adaptive", &check<adaptive::PointSet>},
+            {"kd_tree_cached", &check<cache::PointSet>},
+    };
+    return all;
+}
+
+// Random case mixing the generator distributions with points that hit stored ones, sit on
+// a small lattice to force ties, or fall outside the data.
+class CaseGenerator
+{
+public:
+    CaseGenerator(const Options & options, std::uint64_t seed)
+        : m_options(options)
+        , m_gen(seed)
+    {
+    }
+
+    Case next()
+    {
+        Case c;
+        const auto & distributions = bench::distributions();
+        auto distribution = distributions[m_gen() % distributions.size()];
+        std::size_t count = m_gen() % (m_options.max_points + 1);
+        // a quarter of the cases start empty and only grow through put()
+        if (m_gen() % 4 != 0) {
+            c.points = bench::generate(distribution, count, m_gen());
+        }
+        m_stored = c.points;
+        std::vector<Operation> queries;
+        std::uniform_int_distribution<std::size_t> kind(0, 99);
+        for (std::size_t i = 0; i < m_options.operations; ++i) {
+            std::size_t roll = kind(m_gen);
+            if (roll < 20) {
+                Point p = point();
+                m_stored.push_back(p);
+                c.operations.push_back({Kind::put, p});
+                continue;
+            }
+            if (!queries.empty() && m_gen() % 4 == 0) {
+                // hot queries come back, so that caching backends answer some from their cache
+                c.operations.push_back(queries[m_gen() % queries.size()]);
+                continue;
+            }
+            if (roll < 45) {
+                c.operations.push_back({Kind::contains, point()});
+            }
+            else if (roll < 65) {
+                c.operations.push_back({Kind::nearest, point()});
+            }
+            else if (roll < 80) {
+                c.operations.push_back({Kind::knn, point(), {0, 0}, m_gen() % 24});
+            }
+            else {
+                Point corner = point();
+                // widths from a thousandth to the whole domain, sometimes degenerate
+                std::uniform_real_distribution<double> exponent(-3, 0.2);
+                double width = m_gen() % 10 == 0 ? 0 : 1000 * std::pow(10, exponent(m_gen));
+                double height = m_gen() % 10 == 0 ? 0 : 1000 * std::pow(10, exponent(m_gen));
+                c.operations.push_back({Kind::range, corner, Point(corner.x() + width, corner.y() + height)});
+            }
+            queries.push_back(c.operations.back());
+        }
+        return c;
+    }
+
+private:
+    const Options & m_options;
+    std::mt19937_64 m_gen;
+    // points of the case so far, for queries that should hit
+    std::vector<Point> m_stored;
+
+    Point point()
+    {
+        std::uniform_real_distribution<double> coord(-100, 1100);
+        switch (m_gen() % 4) {
+        case 0:
+            if (!m_stored.empty()) {
+                return m_stored[m_gen() % m_stored.size()];
+            }
+            [[fallthrough]];
+        case 1: {
+            double x = coord(m_gen);
+            return {x, coord(m_gen)};
+        }
+        case 2: {
+            double x = static_cast<double>(m_gen() % 16);
+            return {x, static_cast<double>(m_gen() % 16)};
+        }
+        default:
+            if (!m_stored.empty()) {
+                const Point & p = m_stored[m_gen() % m_stored.size()];
+                return {p.x() + 1e-3, p.y()};
+            }
+            return {coord(m_gen), 0};
+        }
+    }
+};
+
+// drops chunks of `items` of halving size while the case keeps failing
+template <typename Items, typename Fails>
+bool removeChunks(Case & c, Items Case::*items, const Fails & fails)
+{
+    bool removed = false;
+    for (std::size_t chunk = std::max<std::size_t>(1, (c.*items).size() / 2); chunk > 0; chunk /= 2) {
+        for (std::size_t start = 0; start < (c.*items).size();) {
+            Case candidate = c;
+            auto & list = candidate.*items;
+            list.erase(list.begin() + start, list.begin() + std::min(start + chunk, list.size()));
+            if (fails(candidate)) {
+                c = std::move(candidate);
+                removed = true;
+            }
+            else {
+                start += chunk;
+            }
+        }
+    }
+    return removed;
+}
+
+// replaces a coordinate by 0 or its rounded value while the case keeps failing
+template <typename Fails>
+bool simplify(Case & c, Point & p, const Fails & fails)
+{
+    bool simplified = false;
+    for (int axis = 0; axis < 2; ++axis) {
+        double value = axis == 0 ? p.x() : p.y();
+        for (double simpler : {0.0, std::round(value)}) {
+            if (simpler == value) {
+                break;
+            }
+            Point original = p;
+            p = axis == 0 ? Point(simpler, p.y()) : Point(p.x(), simpler);
+            if (fails(c)) {
+                simplified = true;
+                break;
+            }
+            p = original;
+        }
+    }
+    return simplified;
+}
+
+// smallest case derived from `c` that still fails on PointSet
+Case shrink(Case c, Check check)
+{
+    // simplifying a corner may turn a range inside out, which is a different case altogether
+    auto fails = [check](const Case & candidate) {
+        bool valid = std::all_of(candidate.operations.begin(), candidate.operations.end(), [](const Operation & op) {
+            return op.kind != Kind::range || (op.p.x() <= op.q.x() && op.p.y() <= op.q.y());
+        });
+        return valid && check(candidate, nullptr).has_value();
+    };
+    if (auto failure = check(c, nullptr); failure && failure->operation < c.operations.size()) {
+        c.operations.erase(c.operations.begin() + failure->operation + 1, c.operations.end());
+    }
+    for (bool progress = true; progress;) {
+        progress = removeChunks(c, &Case::operations, fails);
+        progress = removeChunks(c, &Case::points, fails) || progress;
+        for (auto & p : c.points) {
+            progress = simplify(c, p, fails) || progress;
+        }
+        for (auto & op : c.operations) {
+            progress = simplify(c, op.p, fails) || progress;
+            if (op.kind == Kind::range) {
+                progress = simplify(c, op.q, fails) || progress;
+            }
+            while (op.kind == Kind::knn && op.k > 0) {
+                --op.k;
+                if (!fails(c)) {
+                    ++op.k;
+                    break;
+                }
+                progress = true;
+            }
+        }
+    }
+    return c;
+}
+
+void writeCase(std::ostream & out, const Case & c)
+{
+    out << std::setprecision(17) << "points " << c.points.size() << "\n";
+    for (const auto & p : c.points) {
+        out << p.x() << " " << p.y() << "\n";
+    }
+    out << "operations " << c.operations.size() << "\n";
+    for (const auto & op : c.operations) {
+        out << name(op.kind) << " " << op.p.x() << " " << op.p.y();
+        if (op.kind == Kind::knn) {
+            out << " " << op.k;
+        }
+        if (op.kind == Kind::range) {
+            out << " " << op.q.x() << " " << op.q.y();
+        }
+        out << "\n";
+    }
+}
+
+// reads what writeCase() wrote
+std::optional<Case> readCase(std::istream & in)
+{
+    Case c;
+    std::string word;
+    std::size_t count = 0;
+    if (!(in >> word >> count) || word != "points") {
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        double x, y;
+        if (!(in >> x >> y)) {
+            return std::nullopt;
+        }
+        c.points.emplace_back(x, y);
+    }
+    if (!(in >> word >> count) || word != "operations") {
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        double x, y;
+        if (!(in >> word >> x >> y)) {
+            return std::nullopt;
+        }
+        auto kind = parseKind(word);
+        if (!kind) {
+            return std::nullopt;
+        }
+        Operation op{*kind, Point(x, y)};
+        if (op.kind == Kind::knn && !(in >> op.k)) {
+            return std::nullopt;
+        }
+        if (op.kind == Kind::range) {
+            if (!(in >> x >> y)) {
+                return std::nullopt;
+            }
+            op.q = Point(x, y);
+        }
+        c.operations.push_back(op);
+    }
+    return c;
+}
+
+void report(const char * backend, const Case & c, const Failure & failure)
+{
+    std::cout << backend << ": " << failure.message;
+    if (failure.operation < c.operations.size()) {
+        std::cout << " at operation " << failure.operation;
+    }
+    std::cout << "\nminimal reproducer (run with --replay <file> --backends " << backend << "):\n";
+    writeCase(std::cout, c);
+}
+
+std::vector<std::string> split(const std::string & list)
+{
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    for (std::string item; std::getline(in, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+void usage(const char * program)
+{
+    std::cerr << "usage: " << program << " [--cases C] [--operations O] [--max-points N] [--seed S]\n"
+              << "       [--backends name,...] [--max-slowdown X] [--replay case.txt]\n"
+              << "checks every operation of every backend against a brute-force oracle and shrinks\n"
+              << "the first failing case of a backend to a minimal reproducer\n";
+}
+
+bool parse(int argc, char ** argv, Options & options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (flag == "--cases") {
+            options.cases = std::stoull(value);
+        }
+        else if (flag == "--operations") {
+            options.operations = std::stoull(value);
+        }
+        else if (flag == "--max-points") {
+            options.max_points = std::stoull(value);
+        }
+        else if (flag == "--seed") {
+            options.seed = std::stoull(value);
+        }
+        else if (flag == "--backends") {
+            options.backends = split(value);
+            for (const auto & name : options.backends) {
+                if (std::none_of(backends().begin(), backends().end(), [&name](const auto & backend) { return name == backend.first; })) {
+                    std::cerr << "unknown backend " << name << "\n";
+                    return false;
+                }
+            }
+        }
+        else if (flag == "--max-slowdown") {
+            options.max_slowdown = std::stod(value);
+        }
+        else if (flag == "--replay") {
+            options.replay = value;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool selected(const Options & options, const char * backend)
+{
+    return options.backends.empty() || std::find(options.backends.begin(), options.backends.end(), backend) != options.backends.end();
+}
+
+int replay(const Options & options)
+{
+    std::ifstream in(options.replay);
+    auto c = readCase(in);
+    if (!c) {
+        std::cerr << "cannot read a case from " << options.replay << "\n";
+        return 1;
+    }
+    int failures = 0;
+    for (const auto & [name, check] : backends()) {
+        if (!selected(options, name)) {
+            continue;
+        }
+        if (auto failure = check(*c, nullptr)) {
+            std::cout << name << ": " << failure->message << " at operation " << failure->operation << "\n";
+            ++failures;
+        }
+        else {
+            std::cout << name << ": ok\n";
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    try {
+        if (!parse(argc, argv, options)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!options.replay.empty()) {
+        return replay(options);
+    }
+
+    std::vector<Timings> timings(backends().size());
+    std::vector<bool> failed(backends().size(), false);
+    CaseGenerator generator(options, options.seed);
+    std::size_t operations = 0;
+    for (std::size_t i = 0; i < options.cases; ++i) {
+        Case c = generator.next();
+        for (std::size_t b = 0; b < backends().size(); ++b) {
+            const auto & [name, check] = backends()[b];
+            if (failed[b] || !selected(options, name)) {
+                continue;
+            }
+            operations += c.operations.size();
+            if (auto failure = check(c, &timings[b])) {
+                // later cases of a broken backend would mostly report the same bug again
+                failed[b] = true;
+                Case minimal = shrink(c, check);
+                report(name, minimal, check(minimal, nullptr).value_or(*failure));
+            }
+        }
+        if ((i + 1) % 100 == 0) {
+            std::cerr << i + 1 << " cases, " << operations << " operations" << std::endl;
+        }
+    }
+
+    bool slow = false;
+    std::cout << std::left << std::setw(16) << "backend" << std::setw(10) << "operation" << std::right << std::setw(12) << "ns/op"
+              << std::setw(12) << "oracle" << std::setw(10) << "ratio" << "\n";
+    for (std::size_t b = 0; b < backends().size(); ++b) {
+        if (!selected(options, backends()[b].first)) {
+            continue;
+        }
+        for (std::size_t kind = 0; kind < kind_count; ++kind) {
+            std::size_t ops = timings[b].ops[kind];
+            if (ops == 0) {
+                continue;
+            }
+            double backend = std::chrono::duration<double, std::nano>(timings[b].backend[kind]).count() / ops;
+            double oracle = std::chrono::duration<double, std::nano>(timings[b].oracle[kind]).count() / ops;
+            double ratio = oracle > 0 ? backend / oracle : 0;
+            bool too_slow = options.max_slowdown > 0 && ratio > options.max_slowdown;
+            slow = slow || too_slow;
+            std::cout << std::left << std::setw(16) << backends()[b].first << std::setw(10) << name(static_cast<Kind>(kind)) << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(12) << backend << std::setw(12) << oracle << std::setprecision(2)
+                      << std::setw(10) << ratio << (too_slow ? "  too slow" : "") << "\n";
+        }
+    }
+    bool any_failed = std::find(failed.begin(), failed.end(), true) != failed.end();
+    return any_failed || slow ? 1 : 0;
+}
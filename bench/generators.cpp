@@ -0,0 +1,143 @@
+#include "generators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <random>
+
+namespace bench {
+
+namespace {
+
+constexpr double domain = 1000;
+
+struct Cluster
+{
+    double x;
+    double y;
+    double sigma;
+};
+
+} // anonymous namespace
+
+const char * name(Distribution distribution)
+{
+    switch (distribution) {
+    case Distribution::uniform:
+        return "uniform";
+    case Distribution::clustered:
+        return "clustered";
+    case Distribution::line:
+        return "line";
+    case Distribution::road:
+        return "road";
+    case Distribution::duplicates:
+        return "duplicates";
+    case Distribution::sorted:
+        return "sorted";
+    }
+    return "unknown";
+}
+
+const std::vector<Distribution> & distributions()
+{
+    static const std::vector<Distribution> all = {
+            Distribution::uniform,
+            Distribution::clustered,
+            Distribution::line,
+            Distribution::road,
+            Distribution::duplicates,
+            Distribution::sorted,
+    };
+    return all;
+}
+
+std::optional<Distribution> parseDistribution(const std::string & value)
+{
+    for (auto distribution : distributions()) {
+        if (value == name(distribution)) {
+            return distribution;
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<Point> generate(Distribution distribution, std::size_t count, std::uint64_t seed)
+{
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<double> coord(0, domain);
+    std::vector<Point> points;
+    points.reserve(count);
+    switch (distribution) {
+    case Distribution::uniform:
+        while (points.size() < count) {
+            double x = coord(gen);
+            points.emplace_back(x, coord(gen));
+        }
+        break;
+    case Distribution::clustered: {
+        std::uniform_real_distribution<double> centre(domain / 10, domain * 9 / 10);
+        std::uniform_real_distribution<double> spread(5, 30);
+        std::vector<Cluster> clusters(16);
+        for (auto & cluster : clusters) {
+            cluster = {centre(gen), centre(gen), spread(gen)};
+        }
+        std::normal_distribution<double> offset;
+        while (points.size() < count) {
+            const auto & cluster = clusters[gen() % clusters.size()];
+            double x = cluster.x + offset(gen) * cluster.sigma;
+            points.emplace_back(x, cluster.y + offset(gen) * cluster.sigma);
+        }
+        break;
+    }
+    case Distribution::line: {
+        // y is x / 2 without rounding, so the points are exactly collinear
+        std::uniform_real_distribution<double> t(0, 1);
+        while (points.size() < count) {
+            double s = t(gen);
+            points.emplace_back(domain * s, domain / 2 * s);
+        }
+        break;
+    }
+    case Distribution::road: {
+        std::normal_distribution<double> turn(0, 0.2);
+        std::normal_distribution<double> jitter(0, 0.05);
+        std::uniform_real_distribution<double> heading(0, 2 * std::numbers::pi);
+        while (points.size() < count) {
+            double x = coord(gen), y = coord(gen), angle = heading(gen);
+            for (std::size_t step = 0; step < 100 && points.size() < count; ++step) {
+                x += std::cos(angle);
+                y += std::sin(angle);
+                angle += turn(gen);
+                double px = x + jitter(gen);
+                points.emplace_back(px, y + jitter(gen));
+            }
+        }
+        break;
+    }
+    case Distribution::duplicates: {
+        std::vector<Point> pool;
+        std::size_t distinct = std::max<std::size_t>(1, count / 10);
+        pool.reserve(distinct);
+        while (pool.size() < distinct) {
+            double x = coord(gen);
+            pool.emplace_back(x, coord(gen));
+        }
+        while (points.size() < count) {
+            points.push_back(pool[gen() % pool.size()]);
+        }
+        break;
+    }
+    case Distribution::sorted: {
+        // columns of a fixed height, so a longer input extends a shorter one to the right
+        std::size_t side = static_cast<std::size_t>(domain);
+        for (std::size_t i = 0; i < count; ++i) {
+            points.emplace_back(static_cast<double>(i / side), static_cast<double>(i % side));
+        }
+        break;
+    }
+    }
+    return points;
+}
+
+} // namespace bench
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+enum class Distribution
+{
+    // uniform in [0, 1000) x [0, 1000)
+    uniform,
+    // Gaussian blobs of different spread
+    clustered,
+    // exactly collinear points on one segment
+    line,
+    // jittered random-walk polylines, like nodes of a road network
+    road,
+    // draws from a pool of n / 10 distinct points
+    duplicates,
+    // integer lattice in lexicographic order, so every prefix is sorted
+    sorted,
+};
+
+const char * name(Distribution distribution);
+std::optional<Distribution> parseDistribution(const std::string & name);
+const std::vector<Distribution> & distributions();
+
+// `count` points of the given distribution, the same for the same seed
+std::vector<Point> generate(Distribution distribution, std::size_t count, std::uint64_t seed);
+
+} // namespace bench
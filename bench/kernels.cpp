@@ -0,0 +1,258 @@
+#include "generators.h"
+#include "kernels.h"
+#include "primitives.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    // points one round of a kernel runs over
+    std::size_t n = 4096;
+    std::size_t rounds = 200;
+    std::uint64_t seed = 42;
+    std::string output;
+};
+
+struct Record
+{
+    std::string kernel;
+    // per point, over the rounds
+    double median_ns = 0;
+    double min_ns = 0;
+};
+
+// keeps the compiler from dropping the kernel results
+volatile double sink;
+
+// Inputs of the kernels. Every round takes another query point and window, so no result can
+// be hoisted out of the round loop.
+struct Inputs
+{
+    std::vector<Point> points;
+    std::vector<Point> others;
+    // about a quarter of the data area each, so that contains answers both ways
+    std::vector<Rect> windows;
+};
+
+Inputs makeInputs(const Options & options)
+{
+    Inputs inputs;
+    inputs.points = bench::generate(bench::Distribution::uniform, options.n, options.seed);
+    inputs.others = bench::generate(bench::Distribution::uniform, options.rounds, options.seed + 1);
+    for (const Point & c : inputs.others) {
+        inputs.windows.emplace_back(Point(c.x() - 250, c.y() - 250), Point(c.x() + 250, c.y() + 250));
+    }
+    // equal points for operator== to find
+    for (std::size_t i = 0; i < inputs.others.size() && i < inputs.points.size(); i += 2) {
+        inputs.others[i] = inputs.points[i];
+    }
+    return inputs;
+}
+
+// runs round(r) for every round and reports the time per point
+Record measure(const std::string & kernel, const Options & options, const std::function<double(std::size_t)> & round)
+{
+    std::vector<double> samples;
+    double total = 0;
+    for (std::size_t r = 0; r < options.rounds; ++r) {
+        auto start = Clock::now();
+        total += round(r);
+        auto elapsed = Clock::now() - start;
+        samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / options.n);
+    }
+    sink = total;
+    std::sort(samples.begin(), samples.end());
+    Record record{kernel, samples[samples.size() / 2], samples.front()};
+    std::cerr << kernel << ": " << record.median_ns << " ns/point (min " << record.min_ns << ")" << std::endl;
+    return record;
+}
+
+std::vector<Record> run(const Options & options, const Inputs & in)
+{
+    const auto & points = in.points;
+    std::unique_ptr<bool[]> mask(new bool[points.size()]);
+    std::vector<double> lengths(points.size());
+
+    std::vector<Record> records;
+    records.push_back(measure("point_distance", options, [&](std::size_t r) {
+        double sum = 0;
+        for (const Point & p : points) {
+            sum += p.distance(in.others[r]);
+        }
+        return sum;
+    }));
+    records.push_back(measure("point_squared_distance", options, [&](std::size_t r) {
+        double sum = 0;
+        for (const Point & p : points) {
+            sum += squaredDistance(p, in.others[r]);
+        }
+        return sum;
+    }));
+    records.push_back(measure("point_equals", options, [&](std::size_t r) {
+        double equal = 0;
+        for (const Point & p : points) {
+            equal += p == in.others[r];
+        }
+        return equal;
+    }));
+    records.push_back(measure("rect_distance", options, [&](std::size_t r) {
+        double sum = 0;
+        for (const Point & p : points) {
+            sum += in.windows[r].distance(p);
+        }
+        return sum;
+    }));
+    records.push_back(measure("rect_contains", options, [&](std::size_t r) {
+        double found = 0;
+        for (const Point & p : points) {
+            found += in.windows[r].contains(p);
+        }
+        return found;
+    }));
+    records.push_back(measure("rect_contains_loop", options, [&](std::size_t r) {
+        double found = 0;
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            mask[i] = in.windows[r].contains(points[i]);
+            found += mask[i];
+        }
+        return found;
+    }));
+    records.push_back(measure("rect_contains_batch", options, [&](std::size_t r) {
+        return static_cast<double>(kernels::contains(in.windows[r], points.data(), points.size(), mask.get()));
+    }));
+    records.push_back(measure("point_distance_loop", options, [&](std::size_t r) {
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            lengths[i] = in.others[r].distance(points[i]);
+        }
+        return lengths.back();
+    }));
+    records.push_back(measure("point_distance_batch", options, [&](std::size_t r) {
+        kernels::distances(in.others[r], points.data(), points.size(), lengths.data());
+        return lengths.back();
+    }));
+    return records;
+}
+
+// the batch kernels have to agree with the scalar ones before their times mean anything
+bool check(const Options & options, const Inputs & in)
+{
+    const auto & points = in.points;
+    std::unique_ptr<bool[]> mask(new bool[points.size()]);
+    std::vector<double> lengths(points.size());
+    for (std::size_t r = 0; r < options.rounds; ++r) {
+        std::size_t found = kernels::contains(in.windows[r], points.data(), points.size(), mask.get());
+        kernels::distances(in.others[r], points.data(), points.size(), lengths.data());
+        std::size_t expected = 0;
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            expected += in.windows[r].contains(points[i]);
+            // fused multiply-adds, when the compiler may use them, change the last bit or so
+            double length = in.others[r].distance(points[i]);
+            if (mask[i] != in.windows[r].contains(points[i]) || std::abs(lengths[i] - length) > 4 * std::numeric_limits<double>::epsilon() * length) {
+                std::cerr << "batch kernels disagree with Rect::contains or Point::distance at point " << i << " of round " << r << std::endl;
+                return false;
+            }
+        }
+        if (found != expected) {
+            std::cerr << "batch contains counted " << found << " points, expected " << expected << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void writeJson(std::ostream & out, const Options & options, const std::vector<Record> & records)
+{
+    out << "{\n"
+        << "  \"n\": " << options.n << ",\n"
+        << "  \"rounds\": " << options.rounds << ",\n"
+        << "  \"seed\": " << options.seed << ",\n"
+        << "  \"instruction_set\": \"" << kernels::instructionSet() << "\",\n"
+        << "  \"results\": [";
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        const Record & r = records[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"kernel\": \"" << r.kernel << "\", \"ns_per_op\": " << r.median_ns << ", \"min_ns_per_op\": " << r.min_ns << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void usage(const char * program)
+{
+    std::cerr << "usage: " << program << " [--n N] [--rounds R] [--seed S] [--output results.json]\n"
+              << "times the Point and Rect kernels and their batch versions over N points, R rounds,\n"
+              << "and reports the median and minimum round time per point\n";
+}
+
+bool parse(int argc, char ** argv, Options & options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (flag == "--n") {
+            options.n = std::stoull(value);
+        }
+        else if (flag == "--rounds") {
+            options.rounds = std::stoull(value);
+        }
+        else if (flag == "--seed") {
+            options.seed = std::stoull(value);
+        }
+        else if (flag == "--output") {
+            options.output = value;
+        }
+        else {
+            return false;
+        }
+    }
+    return options.n > 0 && options.rounds > 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    try {
+        if (!parse(argc, argv, options)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Inputs inputs = makeInputs(options);
+    std::cerr << "batch kernels: " << kernels::instructionSet() << std::endl;
+    if (!check(options, inputs)) {
+        return 1;
+    }
+    std::vector<Record> records = run(options, inputs);
+
+    if (options.output.empty()) {
+        writeJson(std::cout, options, records);
+    }
+    else {
+        std::ofstream out(options.output);
+        writeJson(out, options, records);
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include "generators.h"
+#include "primitives.h"
+#include "resources.h"
+
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options
+{
+    std::vector<std::size_t> sizes = {10000, 100000, 1000000};
+    std::vector<bench::Distribution> datasets = {bench::Distribution::uniform};
+    std::uint64_t seed = 42;
+    std::string output;
+};
+
+// what one backend reports for one input next to what the RSS says
+struct Measurement
+{
+    MemoryUsage usage;
+    std::size_t size = 0;
+    std::size_t rss_delta = 0;
+};
+
+struct Record
+{
+    const char * backend;
+    bench::Distribution dataset;
+    std::size_t n;
+    Measurement measurement;
+};
+
+// RSS after returning freed memory to the system, so only live allocations count
+std::size_t settledRss()
+{
+    malloc_trim(0);
+    return bench::currentRss();
+}
+
+template <typename PointSet>
+void build(std::optional<PointSet> & set, const std::vector<Point> & points)
+{
+    set.emplace(points);
+}
+
+// the rb-tree has no constructor from a point list, so it grows the way users fill it
+template <>
+void build(std::optional<rbtree::PointSet> & set, const std::vector<Point> & points)
+{
+    set.emplace();
+    for (const auto & p : points) {
+        set->put(p);
+    }
+}
+
+template <typename PointSet>
+Measurement measure(const std::vector<Point> & points)
+{
+    Measurement result;
+    std::size_t before = settledRss();
+    std::optional<PointSet> set;
+    build(set, points);
+    std::size_t after = settledRss();
+    result.usage = set->memoryUsage();
+    result.size = set->size();
+    result.rss_delta = after > before ? after - before : 0;
+    return result;
+}
+
+using Measure = Measurement (*)(const std::vector<Point> &);
+
+const std::vector<std::pair<const char *, Measure>> & backends()
+{
+    static const std::vector<std::pair<const char *, Measure>> all = {
+            {"rb_tree", &measure<rbtree::PointSet>},
+            {"kd_tree", &measure<kdtree::PointSet>},
+    };
+    return all;
+}
+
+// runs `measure` in a child process, so the heap of earlier measurements cannot absorb the
+// allocations of this one
+bool isolated(Measure measure, const std::vector<Point> & points, Measurement & result)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        Measurement measurement = measure(points);
+        bool written = write(fds[1], &measurement, sizeof(measurement)) == sizeof(measurement);
+        _exit(written ? 0 : 1);
+    }
+    close(fds[1]);
+    bool read_all = read(fds[0], &result, sizeof(result)) == sizeof(result);
+    close(fds[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    return read_all && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void writeJson(std::ostream & out, const Options & options, const std::vector<Record> & records)
+{
+    out << "{\n"
+        << "  \"seed\": " << options.seed << ",\n"
+        << "  \"results\": [";
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        const Record & r = records[i];
+        const MemoryUsage & usage = r.measurement.usage;
+        double ratio = r.measurement.rss_delta == 0 ? 0 : static_cast<double>(usage.total()) / r.measurement.rss_delta;
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"backend\": \"" << r.backend << "\", \"dataset\": \"" << bench::name(r.dataset) << "\", \"n\": " << r.n
+            << ", \"size\": " << r.measurement.size << ", \"nodes\": " << usage.nodes << ", \"points\": " << usage.points
+            << ", \"control_blocks\": " << usage.control_blocks << ", \"summaries\": " << usage.summaries
+            << ", \"scratch\": " << usage.scratch << ", \"total\": " << usage.total()
+            << ", \"rss_delta\": " << r.measurement.rss_delta << ", \"total_to_rss\": " << ratio << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+std::vector<std::string> split(const std::string & list)
+{
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    for (std::string item; std::getline(in, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+void usage(const char * program)
+{
+    std::cerr << "usage: " << program << " [--n 10000,100000,1000000] [--datasets uniform,...] [--seed S] [--output memory.json]\n"
+              << "compares memoryUsage().total() of each backend with the RSS its construction adds\n";
+}
+
+bool parse(int argc, char ** argv, Options & options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (flag == "--n") {
+            options.sizes.clear();
+            for (const auto & item : split(value)) {
+                options.sizes.push_back(std::stoull(item));
+            }
+        }
+        else if (flag == "--datasets") {
+            options.datasets.clear();
+            for (const auto & name : split(value)) {
+                auto distribution = bench::parseDistribution(name);
+                if (!distribution) {
+                    std::cerr << "unknown dataset " << name << "\n";
+                    return false;
+                }
+                options.datasets.push_back(*distribution);
+            }
+        }
+        else if (flag == "--seed") {
+            options.seed = std::stoull(value);
+        }
+        else if (flag == "--output") {
+            options.output = value;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    try {
+        if (!parse(argc, argv, options)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Record> records;
+    for (auto distribution : options.datasets) {
+        for (std::size_t n : options.sizes) {
+            std::vector<Point> points = bench::generate(distribution, n, options.seed);
+            for (const auto & [name, measure] : backends()) {
+                Measurement measurement;
+                if (!isolated(measure, points, measurement)) {
+                    std::cerr << name << " " << bench::name(distribution) << " " << n << ": measurement failed\n";
+                    return 1;
+                }
+                records.push_back({name, distribution, n, measurement});
+                std::cerr << name << " " << bench::name(distribution) << " " << n << ": reported " << measurement.usage.total()
+                          << " bytes, rss grew by " << measurement.rss_delta << std::endl;
+            }
+        }
+    }
+
+    if (options.output.empty()) {
+        writeJson(std::cout, options, records);
+    }
+    else {
+        std::ofstream out(options.output);
+        writeJson(out, options, records);
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "resources.h"
+
+#include <fstream>
+#include <string>
+
+#include <sys/resource.h>
+
+namespace bench {
+
+namespace {
+
+// value in bytes of a "<field>: <n> kB" line of /proc/self/status, 0 when missing
+std::size_t statusField(const std::string & field)
+{
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    while (status >> key) {
+        if (key == field + ":") {
+            std::size_t kilobytes = 0;
+            status >> kilobytes;
+            return kilobytes * 1024;
+        }
+        status.ignore(4096, '\n');
+    }
+    return 0;
+}
+
+} // anonymous namespace
+
+std::size_t currentRss()
+{
+    return statusField("VmRSS");
+}
+
+std::size_t peakRss()
+{
+    if (std::size_t peak = statusField("VmHWM")) {
+        return peak;
+    }
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+}
+
+bool resetPeakRss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    return static_cast<bool>(clear_refs << "5" << std::flush);
+}
+
+} // namespace bench
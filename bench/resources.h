@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+namespace bench {
+
+// resident set size of the process in bytes, 0 when it cannot be read
+std::size_t currentRss();
+// highest resident set size since start or since the last successful resetPeakRss()
+std::size_t peakRss();
+// restarts peak tracking from the current RSS (Linux /proc/self/clear_refs); when that is not
+// available peakRss() keeps reporting the peak over the whole run and this returns false
+bool resetPeakRss();
+
+} // namespace bench
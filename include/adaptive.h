@@ -0,0 +1,147 @@
+#pragma once
+
+#include "grid.h"
+#include "primitives.h"
+#include "zorder.h"
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace adaptive {
+
+enum class Backend
+{
+    kdtree,
+    grid,
+    zorder,
+};
+
+const char * name(Backend backend);
+
+// what the input looked like when the backend was chosen
+struct Profile
+{
+    std::size_t count = 0;
+    double xmin = 0;
+    double ymin = 0;
+    double xmax = 0;
+    double ymax = 0;
+    // variance to mean ratio of per-cell counts on a grid of about count / 4 cells:
+    // close to 1 for uniform data, much larger for clustered data
+    double dispersion = 0;
+    // share of input points that repeated an earlier one
+    double duplicate_ratio = 0;
+    // puts per operation, observed or as given in Options
+    double update_rate = 0;
+};
+
+struct Decision
+{
+    Backend backend = Backend::kdtree;
+    Profile profile;
+    std::string reason;
+};
+
+struct Options
+{
+    // expected share of put() among all operations, used until enough operations are observed
+    double expected_update_rate = 0;
+    // update rate above which the dynamic kd-tree is preferred over the static indexes
+    double dynamic_threshold = 0.05;
+    // dispersion below which the data counts as uniform and goes to the grid
+    double uniform_dispersion = 2;
+};
+
+// Facade that profiles its input and stores it in the backend that suits it best.
+// The choice is revisited by reBuild(), which put() also calls whenever the size has doubled
+// since the last decision.
+class PointSet
+{
+public:
+    using Backends = std::variant<kdtree::PointSet, grid::PointSet, zorder::PointSet<>>;
+
+    // iterating over the whole set is not a hot path, so one iterator type covers all backends;
+    // query results are PointViews and stay contiguous
+    class iterator
+    {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = Point;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() = default;
+        friend bool operator==(const iterator & lhs, const iterator & rhs)
+        {
+            return lhs.m_it == rhs.m_it;
+        }
+        friend bool operator!=(const iterator & lhs, const iterator & rhs)
+        {
+            return lhs.m_it != rhs.m_it;
+        }
+        reference operator*() const
+        {
+            return std::visit([](const auto & it) -> reference { return *it; }, m_it);
+        }
+        pointer operator->() const
+        {
+            return &operator*();
+        }
+        iterator & operator++()
+        {
+            std::visit([](auto & it) { ++it; }, m_it);
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            auto tmp = *this;
+            operator++();
+            return tmp;
+        }
+
+    private:
+        friend class PointSet;
+        template <typename It>
+        iterator(const It & it)
+            : m_it(it)
+        {
+        }
+        std::variant<kdtree::PointSet::iterator, std::vector<Point>::const_iterator> m_it;
+    };
+
+    PointSet(const std::string & filename = {}, const Options & options = {});
+    PointSet(std::vector<Point> points, const Options & options = {});
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    // profiles the current points again and moves them to another backend if the choice changed
+    void reBuild();
+    const Decision & decision() const;
+
+    friend std::ostream & operator<<(std::ostream &, const PointSet &);
+
+private:
+    Options m_options;
+    Decision m_decision;
+    Backends m_backend;
+    std::size_t m_puts = 0;
+    mutable std::atomic<std::size_t> m_queries = 0;
+
+    void choose(std::vector<Point> points, double update_rate);
+    double updateRate() const;
+};
+
+} // namespace adaptive
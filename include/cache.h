@@ -0,0 +1,150 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cache {
+
+struct Options
+{
+    // range() keys are the query rectangle widened to multiples of this, so viewports that
+    // differ by less share an entry (the cached superset is filtered down to the exact rectangle
+    // on a hit); 0 keys on the exact rectangle
+    double quantum = 0;
+    // side of the square regions whose version counters put() bumps; 0 picks 1/64 of the larger
+    // side of the bounding box of the initial points
+    double region_size = 0;
+    // region versions live in this many slots, regions sharing a slot invalidate each other
+    std::size_t version_slots = std::size_t{1} << 16;
+    // an entry overlapping more regions than this depends on every put() instead
+    std::size_t max_regions = 64;
+    std::size_t shards = 16;
+    // bytes of cached results and their bookkeeping over all shards
+    std::size_t capacity = std::size_t{64} << 20;
+};
+
+struct Stats
+{
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    // entries found but dropped because a put() touched one of their regions
+    std::size_t invalidations = 0;
+    // entries dropped to stay within the capacity
+    std::size_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+
+    double hitRate() const;
+};
+
+// A kdtree::PointSet with an LRU cache of range(), nearest() and k nearest results in front.
+// Every entry records the version of each region its answer depends on: the regions its
+// rectangle overlaps for range(), and those overlapping the square around the query point that
+// holds the (k-th) nearest point for nearest(). put() bumps the version of the region of the
+// new point, so exactly the entries it can change go stale (and those sharing a version slot).
+// Results are what the kd-tree answers, except that among points at the same distance a cached
+// nearest() may name another one than a fresh query after a rebuild would.
+//
+// Queries may run concurrently with each other, each shard of the cache having its own lock;
+// put() needs exclusive access, as for kdtree::PointSet.
+class PointSet
+{
+public:
+    using iterator = kdtree::PointSet::iterator;
+
+    PointSet(const std::string & filename = {}, const Options & options = {});
+    PointSet(std::vector<Point> points, const Options & options = {});
+    PointSet(const PointSet &) = delete;
+    PointSet & operator=(const PointSet &) = delete;
+
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    // not cached, a lookup is as cheap as a cache probe
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    const kdtree::PointSet & tree() const;
+    Stats stats() const;
+    // drops every entry and zeroes the counters
+    void clear();
+
+private:
+    enum class Kind : std::uint8_t
+    {
+        range,
+        nearest,
+        knn,
+    };
+
+    struct Key
+    {
+        Kind kind;
+        // bit patterns of the (widened) rectangle or of the query point
+        std::uint64_t coordinates[4];
+        std::size_t k;
+
+        bool operator==(const Key &) const = default;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key & key) const;
+    };
+
+    // the answer of a query and the region versions it was computed at
+    struct Entry
+    {
+        Key key;
+        PointView result;
+        std::vector<std::pair<std::size_t, std::uint64_t>> versions;
+        std::size_t bytes;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        std::size_t bytes = 0;
+    };
+
+    Options m_options;
+    kdtree::PointSet m_tree;
+    // one per slot, and a last one that every put() bumps
+    std::vector<std::uint64_t> m_versions;
+    std::unique_ptr<Shard[]> m_shards;
+    mutable std::atomic<std::size_t> m_hits = 0;
+    mutable std::atomic<std::size_t> m_misses = 0;
+    mutable std::atomic<std::size_t> m_invalidations = 0;
+    mutable std::atomic<std::size_t> m_evictions = 0;
+
+    std::size_t slot(double x, double y) const;
+    // the versions of the regions overlapping [xmin, xmax] x [ymin, ymax]
+    std::vector<std::pair<std::size_t, std::uint64_t>> versionsOf(double xmin, double ymin, double xmax, double ymax) const;
+    std::vector<std::pair<std::size_t, std::uint64_t>> versionsAround(const Point & p, const PointView & found, std::size_t k) const;
+    bool current(const Entry & entry) const;
+    // the cached answer for `key`, or compute() stored under it; compute returns the answer and
+    // the region versions it depends on
+    template <typename Compute>
+    PointView lookup(const Key & key, Compute && compute) const;
+    Shard & shardOf(const Key & key) const;
+};
+
+} // namespace cache
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cluster {
+
+// label of points that belong to no cluster
+constexpr std::int32_t noise = -1;
+
+struct Options
+{
+    // threads of the core point pass; 0 takes one per hardware thread
+    std::size_t threads = 0;
+};
+
+struct Clustering
+{
+    // the points of the set, ordered by x and then y
+    std::vector<Point> points;
+    // labels[i] is the cluster of points[i], numbered from 0 in the order of their first core
+    // point, or noise
+    std::vector<std::int32_t> labels;
+    std::size_t clusters = 0;
+    std::size_t core_points = 0;
+};
+
+// DBSCAN over the points of `points`. A point is a core point if at least `min_pts` points,
+// itself included, lie within `eps` of it. Clusters are the core points connected through
+// such neighbourhoods, together with the points within `eps` of them; a border point near
+// several clusters joins the first one that reaches it.
+//
+// The neighbourhood counts are taken in parallel, one kdtree::PointSet::within() query per
+// point; the clusters are then grown one after the other from the core points, a shared
+// visited bitmap making sure each core point is expanded once.
+Clustering dbscan(const kdtree::PointSet & points, double eps, std::size_t min_pts, const Options & options = {});
+
+} // namespace cluster
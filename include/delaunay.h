@@ -0,0 +1,72 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace delaunay {
+
+// Static nearest neighbour index over the Delaunay graph of the points. A query jumps to the
+// start point of its cell in a coarse grid and walks from there to whichever Delaunay
+// neighbour is closer until none is: on a Delaunay triangulation that local minimum is the
+// nearest point, i.e. the query lies in its Voronoi cell. k nearest neighbours grow from it
+// best-first, since the i-th nearest point is always adjacent to one of the first i - 1.
+// Points are stored grouped by grid cell, which keeps Delaunay neighbours close in memory and
+// serves contains() and range() the way grid::PointSet does.
+class PointSet
+{
+public:
+    using iterator = std::vector<Point>::const_iterator;
+
+    PointSet(const std::string & filename = {});
+    PointSet(std::vector<Point> points);
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    friend std::ostream & operator<<(std::ostream &, const PointSet &);
+
+private:
+    // average number of points per cell of the grid
+    static constexpr double points_per_cell = 4;
+
+    // indexed points grouped by cell followed by points added by put() since the last rebuild
+    std::vector<Point> m_points;
+    std::size_t m_indexed = 0;
+    // points of cell c are m_points[m_cell_offsets[c]] .. m_points[m_cell_offsets[c + 1]]
+    std::vector<std::size_t> m_cell_offsets;
+    // walks for queries in cell c start at point m_start[c]
+    std::vector<std::size_t> m_start;
+    // Delaunay neighbours of point i are m_adjacent[m_offsets[i]] .. m_adjacent[m_offsets[i + 1]]
+    std::vector<std::size_t> m_offsets;
+    std::vector<std::size_t> m_adjacent;
+    double m_xmin = 0;
+    double m_ymin = 0;
+    double m_cell = 1;
+    std::size_t m_nx = 0;
+    std::size_t m_ny = 0;
+
+    void reBuild();
+    void buildCells();
+    void buildGraph();
+    // fills m_adjacent from m_offsets holding per-point edge counts; edges(visit) calls
+    // visit(a, b) once for every directed edge
+    template <typename Edges>
+    void link(Edges && edges);
+    std::size_t cellX(double x) const;
+    std::size_t cellY(double y) const;
+    // index of the indexed point nearest to p, m_indexed must be positive
+    std::size_t walk(const Point & p) const;
+};
+
+} // namespace delaunay
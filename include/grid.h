@@ -0,0 +1,58 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace grid {
+
+// Uniform bucket grid. Points are kept in one array grouped by cell (CSR layout),
+// followed by an unsorted tail of points added by put() since the last rebuild.
+class PointSet
+{
+public:
+    using iterator = std::vector<Point>::const_iterator;
+
+    PointSet(const std::string & filename = {});
+    PointSet(std::vector<Point> points);
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    friend std::ostream & operator<<(std::ostream &, const PointSet &);
+
+private:
+    // average occupancy the cell size is chosen for
+    static constexpr double points_per_cell = 2;
+
+    std::vector<Point> m_points;
+    // points of cell c are m_points[m_offsets[c]] .. m_points[m_offsets[c + 1]]
+    std::vector<std::size_t> m_offsets;
+    std::size_t m_indexed = 0;
+    double m_xmin = 0;
+    double m_ymin = 0;
+    double m_cell = 1;
+    std::size_t m_nx = 0;
+    std::size_t m_ny = 0;
+
+    void reBuild();
+    std::size_t cellX(double x) const;
+    std::size_t cellY(double y) const;
+    // squared lower bound of the distance from p to cells r or more rings away from (cx, cy),
+    // infinity when there are no such cells
+    double ringBound(const Point & p, std::size_t cx, std::size_t cy, std::size_t r) const;
+    template <typename Visit>
+    void visitRing(std::size_t cx, std::size_t cy, std::size_t r, Visit && visit) const;
+};
+
+} // namespace grid
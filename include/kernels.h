@@ -0,0 +1,22 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <cstddef>
+
+// Batch versions of the geometric kernels the indexes run per visited node, vectorized with
+// AVX2 or SSE2 when the library is compiled for them and scalar otherwise.
+namespace kernels {
+
+// out[i] = whether points[i] lies in rect, borders included; returns how many do.
+// Rect::contains accepts points up to machine epsilon outside the borders as well, so the two
+// differ only for points that close to an edge.
+std::size_t contains(const Rect & rect, const Point * points, std::size_t count, bool * out);
+
+// out[i] = p.distance(points[i]), up to rounding in the last bit
+void distances(const Point & p, const Point * points, std::size_t count, double * out);
+
+// "avx2", "sse2" or "scalar", whichever the batch kernels were compiled for
+const char * instructionSet();
+
+} // namespace kernels
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace latency {
+
+enum class Operation
+{
+    put,
+    contains,
+    nearest,
+    // nearest(p, k)
+    knn,
+    range,
+    // index (re)construction, including the one a put() triggers
+    rebuild,
+};
+
+constexpr std::size_t operation_count = 6;
+
+const char * name(Operation operation);
+
+class Snapshot;
+Snapshot snapshot(Operation operation);
+
+// Log-bucketed latency histogram in the HDR style: every power of two of nanoseconds is split
+// into 2^sub_bucket_bits linear buckets, so a recorded value is known to within 1 / 32 of itself.
+// Values from 2^max_bits ns (about 73 minutes) on share the last bucket.
+class Snapshot
+{
+public:
+    static constexpr unsigned sub_bucket_bits = 5;
+    static constexpr unsigned max_bits = 42;
+    static constexpr std::size_t bucket_count = (max_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+
+    static std::size_t bucketOf(std::uint64_t nanoseconds);
+    // largest value that falls into `bucket`
+    static std::uint64_t upperBound(std::size_t bucket);
+
+    Snapshot();
+
+    std::uint64_t count() const;
+    // exact minimum, maximum and mean over the recorded values, 0 when there are none
+    std::uint64_t min() const;
+    std::uint64_t max() const;
+    double mean() const;
+    // smallest bucket bound at or above `percent` percent of the values, in nanoseconds
+    std::uint64_t percentile(double percent) const;
+
+    const std::vector<std::uint64_t> & buckets() const;
+
+    Snapshot & operator+=(const Snapshot & other);
+
+private:
+    friend Snapshot snapshot(Operation operation);
+
+    std::vector<std::uint64_t> m_buckets;
+    std::uint64_t m_count = 0;
+    std::uint64_t m_sum = 0;
+    std::uint64_t m_min = 0;
+    std::uint64_t m_max = 0;
+};
+
+// Adds one value to the histogram of `operation`. Each thread writes its own buckets without
+// locking; snapshot() merges the buckets of all threads, including ones that have exited.
+void record(Operation operation, std::uint64_t nanoseconds);
+Snapshot snapshot(Operation operation);
+// clears every histogram; values recorded concurrently with the reset may survive it
+void reset();
+
+// Records the lifetime of the scope into the histogram of its operation. The point sets time
+// their operations with it, which only happens when the library is built with
+// LATENCY_HISTOGRAMS; otherwise it is empty and the histograms stay empty.
+class Timer
+{
+public:
+    explicit Timer(Operation operation)
+#ifdef LATENCY_HISTOGRAMS
+        : m_operation(operation)
+        , m_start(std::chrono::steady_clock::now())
+#endif
+    {
+        static_cast<void>(operation);
+    }
+
+    Timer(const Timer &) = delete;
+    Timer & operator=(const Timer &) = delete;
+
+#ifdef LATENCY_HISTOGRAMS
+    ~Timer()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        record(m_operation, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    Operation m_operation;
+    std::chrono::steady_clock::time_point m_start;
+#endif
+};
+
+} // namespace latency
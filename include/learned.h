@@ -0,0 +1,55 @@
+#pragma once
+
+#include "zorder.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace learned {
+
+// Two stage recursive model index over a sorted array of codes. A linear root model picks
+// a segment, the least squares line of that segment predicts the position, and a lower bound
+// search over the segment's recorded error window finishes the lookup. Plugs into
+// zorder::PointSet as its Search policy.
+class Model
+{
+public:
+    void build(const std::vector<std::uint64_t> & codes);
+    // first index in [first, last) whose code is not less than `code`
+    std::size_t lowerBound(const std::vector<std::uint64_t> & codes, std::uint64_t code, std::size_t first, std::size_t last) const;
+    std::size_t segments() const;
+    // largest prediction error over all segments, in positions
+    std::size_t maxError() const;
+
+private:
+    static constexpr std::size_t keys_per_segment = 256;
+
+    struct Segment
+    {
+        std::uint64_t first_key = 0;
+        double slope = 0;
+        double intercept = 0;
+        std::size_t error = 0;
+        // positions of the codes routed to this segment
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    std::uint64_t m_min_key = 0;
+    double m_root_scale = 0;
+    std::vector<Segment> m_segments;
+
+    std::size_t segmentOf(std::uint64_t code) const;
+    static double predict(const Segment & segment, std::uint64_t code);
+};
+
+// Z-order sorted array whose lookups go through the learned model instead of binary search
+using PointSet = zorder::PointSet<Model>;
+
+} // namespace learned
+
+namespace zorder {
+
+extern template class PointSet<learned::Model>;
+
+} // namespace zorder
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// Morton (Z-order) codes of 32 bit grid coordinates: x takes the even bits, y the odd ones
+namespace morton {
+
+inline std::uint64_t spread(std::uint32_t v)
+{
+    std::uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+
+inline std::uint32_t compact(std::uint64_t x)
+{
+    x &= 0x5555555555555555ull;
+    x = (x | (x >> 1)) & 0x3333333333333333ull;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFull;
+    return static_cast<std::uint32_t>(x);
+}
+
+inline std::uint64_t encode(std::uint32_t x, std::uint32_t y)
+{
+    return spread(x) | (spread(y) << 1);
+}
+
+inline std::uint32_t decodeX(std::uint64_t code)
+{
+    return compact(code);
+}
+
+inline std::uint32_t decodeY(std::uint64_t code)
+{
+    return compact(code >> 1);
+}
+
+} // namespace morton
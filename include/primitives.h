@@ -4,10 +4,11 @@
 #include <iterator>
 #include <map>
 #include <memory>
+#include <optional>
+#include <ranges>
 #include <set>
 #include <string>
 #include <type_traits>
-#include <variant>
 #include <vector>
 
 class Point
@@ -62,15 +63,81 @@ public:
     {
         return right_top.y();
     }
+    template <std::size_t Axis>
+    double min() const
+    {
+        return Axis == 0 ? xmin() : ymin();
+    }
+    template <std::size_t Axis>
+    double max() const
+    {
+        return Axis == 0 ? xmax() : ymax();
+    }
     double distance(const Point & p) const;
 
     bool contains(const Point & p) const;
     bool intersects(const Rect &) const;
 };
 
-using VectorIterator = std::vector<Point>::iterator;
+// Result of a query: a cheaply copyable view sharing ownership of the found points.
+// Iterators are plain pointers, so consumers get a contiguous range to compose with std::views.
+class PointView : public std::ranges::view_interface<PointView>
+{
+    std::shared_ptr<const std::vector<Point>> m_points;
+
+public:
+    using iterator = const Point *;
+
+    PointView() = default;
+    explicit PointView(std::vector<Point> && points)
+        : m_points(std::make_shared<const std::vector<Point>>(std::move(points)))
+    {
+    }
+    iterator begin() const
+    {
+        return m_points ? m_points->data() : nullptr;
+    }
+    iterator end() const
+    {
+        return m_points ? m_points->data() + m_points->size() : nullptr;
+    }
+};
+
+static_assert(std::ranges::view<PointView> && std::ranges::contiguous_range<PointView>);
+
+inline double squaredDistance(const Point & lhs, const Point & rhs)
+{
+    double dx = lhs.x() - rhs.x();
+    double dy = lhs.y() - rhs.y();
+    return dx * dx + dy * dy;
+}
+
+// reads whitespace separated "x y" pairs, stopping at the first malformed one
+std::vector<Point> readPoints(const std::string & filename);
+// sorts points lexicographically and drops equal ones
+std::vector<Point> uniquePoints(std::vector<Point> points);
+
+// Heap bytes a point set holds, by what they are spent on. Every allocation is counted at the
+// chunk size a glibc-style allocator gives it, so the total is what building the set adds to
+// the resident set size.
+struct MemoryUsage
+{
+    // tree nodes: links, depth and the allocator overhead of the node allocations
+    std::size_t nodes = 0;
+    // the stored points, with the overhead of allocations made just for them
+    std::size_t points = 0;
+    // reference counts of the shared_ptr nodes
+    std::size_t control_blocks = 0;
+    // per-node aggregates such as bounding boxes or subtree sizes
+    std::size_t summaries = 0;
+    // held only while the set rebuilds itself, on top of the rest
+    std::size_t scratch = 0;
+
+    // everything but scratch
+    std::size_t total() const;
+};
+
 using SetIterator = std::set<Point>::iterator;
-using PointVectorPtr = std::shared_ptr<std::vector<Point>>;
 
 namespace rbtree {
 
@@ -98,21 +165,15 @@ public:
         }
         reference operator*() const
         {
-            if (std::holds_alternative<VectorIterator>(m_it)) {
-                return *std::get<VectorIterator>(m_it);
-            }
-            return *std::get<SetIterator>(m_it);
+            return *m_it;
         }
         pointer operator->() const
         {
-            if (std::holds_alternative<VectorIterator>(m_it)) {
-                return &*std::get<VectorIterator>(m_it);
-            }
-            return &*std::get<SetIterator>(m_it);
+            return &*m_it;
         }
         iterator & operator++()
         {
-            std::visit([&](auto & it) { ++it; }, m_it);
+            ++m_it;
             return *this;
         }
         iterator operator++(int)
@@ -124,26 +185,11 @@ public:
 
     private:
         friend class PointSet;
-        iterator(const PointVectorPtr & points)
-            : m_it(points->begin())
-            , m_points(points)
-        {
-        }
         iterator(const SetIterator & it)
             : m_it(it)
         {
         }
-        iterator(const VectorIterator & it)
-            : m_it(it)
-        {
-        }
-        iterator(const PointSet & points)
-            : m_it(points.m_set.begin())
-            , m_points(&points)
-        {
-        }
-        std::variant<VectorIterator, SetIterator> m_it;
-        std::variant<PointVectorPtr, const PointSet *> m_points;
+        SetIterator m_it;
     };
 
     PointSet(const std::string & filename = {});
@@ -153,14 +199,14 @@ public:
     void put(const Point &);
     bool contains(const Point &) const;
 
-    // second iterator points to an element out of range
-    std::pair<iterator, iterator> range(const Rect &) const;
+    PointView range(const Rect &) const;
     iterator begin() const;
     iterator end() const;
 
     std::optional<Point> nearest(const Point &) const;
-    // second iterator points to an element out of range
-    std::pair<iterator, iterator> nearest(const Point & p, std::size_t k) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    MemoryUsage memoryUsage() const;
 
     friend std::ostream & operator<<(std::ostream &, const PointSet &);
 };
@@ -169,6 +215,58 @@ public:
 
 namespace kdtree {
 
+// Traversal counters of kd-tree queries. Counters of several queries add up, except max_depth,
+// which keeps the deepest node reached by any of them.
+struct QueryStats
+{
+    std::size_t nodes_visited = 0;
+    // visited nodes without children
+    std::size_t leaves_visited = 0;
+    // point to point distances and point equality or rectangle containment tests
+    std::size_t distance_evaluations = 0;
+    // non-empty subtrees skipped because they could not contribute
+    std::size_t subtrees_pruned = 0;
+    // points returned, or found for contains()
+    std::size_t results = 0;
+    // depth of the deepest visited node, the root being at depth 0
+    std::size_t max_depth = 0;
+
+    QueryStats & operator+=(const QueryStats & other);
+};
+
+// When put() rebuilds the tree. The cost it watches is the average search path, the number of
+// nodes a lookup of a stored point visits, against that of a perfectly balanced tree of the same
+// size: a rebuild costs O(n log n), so it pays off once every lookup has become a fixed factor
+// slower, however large the tree is.
+struct RebuildPolicy
+{
+    // growth of the average search path over the balanced one since the last build beyond
+    // which put() rebuilds
+    double max_path_ratio = 1.5;
+    // depth of the deepest node over log2 of the size beyond which put() rebuilds, bounding
+    // the worst case path as well; 0 leaves it unbounded
+    double max_depth_ratio = 0;
+    // smaller trees are never rebuilt, lookups in them are cheap whatever their shape
+    std::size_t min_size = 64;
+};
+
+// Shape of a kd-tree, as computed by PointSet::shape().
+struct TreeShape
+{
+    std::size_t size = 0;
+    // depth of the deepest node, the root being at depth 0
+    std::size_t max_depth = 0;
+    // depth_histogram[d] nodes are at depth d
+    std::vector<std::size_t> depth_histogram;
+    // mean over the inner nodes of level d of |left size - right size| / (left size + right size),
+    // 0 for a level whose subtrees are split evenly and 1 for one of chains
+    std::vector<double> level_imbalance;
+    // nodes visited by a lookup of a stored point, averaged over all of them
+    double average_path = 0;
+    // the same for a perfectly balanced tree of this size
+    double balanced_path = 0;
+};
+
 class PointSet
 {
     struct Node
@@ -211,26 +309,15 @@ public:
         }
         reference operator*() const
         {
-            if (std::holds_alternative<VectorIterator>(m_current)) {
-                return *std::get<VectorIterator>(m_current);
-            }
-            return *std::get<NodePtr>(m_current)->m_point;
+            return *m_current->m_point;
         }
         pointer operator->() const
         {
-            if (std::holds_alternative<VectorIterator>(m_current)) {
-                return &*std::get<VectorIterator>(m_current);
-            }
-            return &*std::get<NodePtr>(m_current)->m_point;
+            return m_current->m_point.get();
         }
         iterator & operator++()
         {
-            if (std::holds_alternative<VectorIterator>(m_current)) {
-                ++std::get<VectorIterator>(m_current);
-            }
-            else {
-                m_current = std::get<const PointSet *>(m_points)->next(std::get<NodePtr>(m_current));
-            }
+            m_current = m_points->next(m_current);
             return *this;
         }
         iterator operator++(int)
@@ -243,8 +330,7 @@ public:
     private:
         friend class PointSet;
         iterator(const PointSet & point_set)
-            : m_current(std::shared_ptr<Node>(nullptr))
-            , m_points(&point_set)
+            : m_points(&point_set)
         {
         }
         iterator(const NodePtr & node, const PointSet & point_set)
@@ -252,32 +338,45 @@ public:
             , m_points(&point_set)
         {
         }
-        iterator(const PointVectorPtr & point_set)
-            : m_current(point_set->begin())
-            , m_points(point_set)
-        {
-        }
-        iterator(const VectorIterator & it)
-            : m_current(it)
-        {
-        }
-        std::variant<VectorIterator, NodePtr> m_current;
-        std::variant<PointVectorPtr, const PointSet *> m_points = nullptr;
+        NodePtr m_current = nullptr;
+        const PointSet * m_points = nullptr;
     };
 
     PointSet(const std::string & filename = {});
+    PointSet(std::vector<Point> points);
     PointSet(const PointSet & set);
     bool empty() const;
     std::size_t size() const;
     void put(const Point &);
     bool contains(const Point &) const;
 
-    std::pair<iterator, iterator> range(const Rect &) const;
+    PointView range(const Rect &) const;
     iterator begin() const;
     iterator end() const;
 
     std::optional<Point> nearest(const Point &) const;
-    std::pair<iterator, iterator> nearest(const Point & p, std::size_t k) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+    // radius query: the points at most `radius` from `center`
+    PointView within(const Point & center, double radius) const;
+
+    // the same queries, also adding their traversal counters to `stats`
+    bool contains(const Point &, QueryStats & stats) const;
+    PointView range(const Rect &, QueryStats & stats) const;
+    std::optional<Point> nearest(const Point &, QueryStats & stats) const;
+    PointView nearest(const Point & p, std::size_t k, QueryStats & stats) const;
+    PointView within(const Point & center, double radius, QueryStats & stats) const;
+
+    // counters of the queries the calling thread made without a stats argument since its last
+    // reset; they are only collected when the library is built with KDTREE_QUERY_STATS
+    static QueryStats threadStats();
+    static void resetThreadStats();
+
+    MemoryUsage memoryUsage() const;
+
+    TreeShape shape() const;
+    const RebuildPolicy & rebuildPolicy() const;
+    // takes effect from the next put()
+    void setRebuildPolicy(const RebuildPolicy & policy);
 
     friend std::ostream & operator<<(std::ostream &, const PointSet &);
 
@@ -285,15 +384,42 @@ private:
     std::size_t max_depth = 0;
     NodePtr m_root = nullptr;
     std::size_t m_size = 0;
-
+    // sum of the depths of all nodes, which gives the average search path
+    std::size_t m_total_depth = 0;
+    // average search path over the balanced one right after the last build; above 1 when ties
+    // along an axis keep the build from splitting evenly, and rebuilding will not do better
+    double m_built_ratio = 1;
+    RebuildPolicy m_policy;
+
+    double pathRatio() const;
+    bool needsRebuild() const;
     void reBuild();
     const NodePtr & insert(const Point & p, NodePtr & current, std::size_t depth);
     static NodePtr left(const NodePtr & current);
-    const NodePtr & find(const Point & p, const NodePtr & current) const;
+    template <typename Stats>
+    static const NodePtr & find(const Point & p, const NodePtr & current, Stats & stats);
     void buildTree(PointSet * tree, std::vector<Point> & points, std::size_t start, std::size_t end, std::size_t depth) const;
-    void findNeighbour(const NodePtr & root, const Point & point, Point & closest_found) const;
-    void findPointsInRectangle(const NodePtr & root, std::vector<Point> & points, const Rect & rect) const;
+    // query kernels are specialized on the split axis of `root` (0 for x, 1 for y),
+    // so the recursion alternates between the two instantiations without testing depth;
+    // `Stats` receives the traversal events and is a no-op unless counters are requested
+    template <std::size_t Axis, typename Metric, typename Stats>
+    static void findNeighbour(const NodePtr & root, const Point & point, const Point *& closest_found, double & best, Stats & stats);
+    // `best` is a max-heap of the k closest (distance, point) pairs found so far
+    template <std::size_t Axis, typename Metric, typename Stats>
+    static void findNeighbours(const NodePtr & root, const Point & point, std::size_t k, std::vector<std::pair<double, const Point *>> & best, Stats & stats);
+    template <std::size_t Axis, typename Output, typename Stats>
+    static void findPointsInRectangle(const NodePtr & root, Output & out, const Rect & rect, Stats & stats);
+    template <typename Stats>
+    std::optional<Point> nearestWith(const Point & p, Stats & stats) const;
+    template <typename Stats>
+    PointView nearestWith(const Point & p, std::size_t k, Stats & stats) const;
+    template <typename Stats>
+    PointView rangeWith(const Rect & rect, Stats & stats) const;
+    template <typename Stats>
+    PointView withinWith(const Point & center, double radius, Stats & stats) const;
     const NodePtr & copyTree(const NodePtr & from, NodePtr & to);
+    // size of the subtree of `node`, adding its nodes to the histogram and imbalance sums of `shape`
+    static std::size_t measureShape(const NodePtr & node, TreeShape & shape, std::vector<std::size_t> & inner);
 };
 
 } // namespace kdtree
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary protocol of 2d_tree_server. Integers and doubles travel in the byte order of the host,
+// since client and server share a machine. A client may send any number of requests without
+// waiting for answers; the responses come back in request order on the same connection, each
+// carrying the id of its request.
+namespace protocol {
+
+enum class Operation : std::uint8_t
+{
+    nearest = 1,
+    knn = 2,
+    range = 3,
+    // size of the range, without the points
+    count = 4,
+    contains = 5,
+};
+
+enum class Status : std::uint8_t
+{
+    ok = 0,
+    // wrong size for the operation; a size the server cannot even skip closes the connection
+    bad_request = 1,
+    unknown_index = 2,
+    unknown_operation = 3,
+};
+
+// Followed by the arguments as doubles: x y for nearest, knn and contains, and the corners
+// x1 y1 x2 y2 of the rectangle for range and count.
+struct RequestHeader
+{
+    // bytes of the whole request, header included
+    std::uint32_t size;
+    // returned in the response
+    std::uint32_t id;
+    Operation operation;
+    // position of the index among the server's --index arguments
+    std::uint8_t index;
+    std::uint16_t reserved;
+    // neighbours to find for knn, ignored otherwise
+    std::uint32_t k;
+};
+
+// Followed by `count` points as x y doubles for nearest (0 or 1), knn and range. count and
+// contains send no points and answer in `count` alone.
+struct ResponseHeader
+{
+    // bytes of the whole response, header included
+    std::uint32_t size;
+    std::uint32_t id;
+    Status status;
+    std::uint8_t reserved[3];
+    std::uint32_t count;
+};
+
+static_assert(sizeof(RequestHeader) == 16 && sizeof(ResponseHeader) == 16);
+
+// doubles following the header of a request, 0 for an unknown operation
+constexpr std::size_t argumentCount(Operation operation)
+{
+    switch (operation) {
+    case Operation::nearest:
+    case Operation::knn:
+    case Operation::contains:
+        return 2;
+    case Operation::range:
+    case Operation::count:
+        return 4;
+    }
+    return 0;
+}
+
+constexpr std::size_t max_request_size = sizeof(RequestHeader) + 4 * sizeof(double);
+
+} // namespace protocol
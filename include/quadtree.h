@@ -0,0 +1,138 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace quadtree {
+
+// Linear PR-quadtree. Coordinates are quantized to 32 bits per axis over a square domain,
+// a cell is identified by its Morton code prefix, and only the leaves are stored: a vector
+// sorted by code that tiles the whole domain. put() finds its leaf by binary search and
+// splits it locally once it holds more than leaf_capacity points; the only global rebuild
+// happens when a point falls outside the domain.
+class PointSet
+{
+    struct Leaf
+    {
+        // first Morton code covered by the leaf
+        std::uint64_t first;
+        unsigned level;
+        std::vector<Point> points;
+    };
+
+public:
+    class iterator
+    {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = Point;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() = default;
+        friend bool operator==(const iterator & lhs, const iterator & rhs)
+        {
+            return lhs.m_leaf == rhs.m_leaf && lhs.m_index == rhs.m_index;
+        }
+        friend bool operator!=(const iterator & lhs, const iterator & rhs)
+        {
+            return !(lhs == rhs);
+        }
+        reference operator*() const
+        {
+            return m_leaf->points[m_index];
+        }
+        pointer operator->() const
+        {
+            return &m_leaf->points[m_index];
+        }
+        iterator & operator++()
+        {
+            ++m_index;
+            skipEmpty();
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            auto tmp = *this;
+            operator++();
+            return tmp;
+        }
+
+    private:
+        friend class PointSet;
+        iterator(const Leaf * leaf, const Leaf * last)
+            : m_leaf(leaf)
+            , m_last(last)
+        {
+            skipEmpty();
+        }
+        void skipEmpty()
+        {
+            while (m_leaf != m_last && m_index == m_leaf->points.size()) {
+                ++m_leaf;
+                m_index = 0;
+            }
+        }
+        const Leaf * m_leaf = nullptr;
+        const Leaf * m_last = nullptr;
+        std::size_t m_index = 0;
+    };
+
+    PointSet(const std::string & filename = {});
+    PointSet(std::vector<Point> points);
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    friend std::ostream & operator<<(std::ostream &, const PointSet &);
+
+private:
+    static constexpr std::size_t leaf_capacity = 16;
+    static constexpr unsigned max_level = 32;
+
+    // a cell at `level` covers the codes whose top 2 * level bits equal `prefix`;
+    // m_leaves[first] .. m_leaves[last] are the leaves tiling it
+    struct Cell
+    {
+        std::uint64_t prefix;
+        unsigned level;
+        std::size_t first;
+        std::size_t last;
+    };
+
+    std::vector<Leaf> m_leaves;
+    std::size_t m_size = 0;
+    double m_xmin = 0;
+    double m_ymin = 0;
+    double m_side = 0;
+
+    void reBuild(std::vector<Point> points);
+    void buildLeaves(std::vector<std::pair<std::uint64_t, Point>> & entries, std::size_t first, std::size_t last, std::uint64_t prefix, unsigned level);
+    bool inDomain(const Point & p) const;
+    std::uint64_t code(const Point & p) const;
+    std::size_t leafOf(std::uint64_t code) const;
+    void split(std::size_t leaf);
+    Cell root() const;
+    Cell child(const Cell & cell, unsigned quadrant) const;
+    // cell bounds widened by one quantization step, so rounding never excludes a point
+    Rect bounds(const Cell & cell) const;
+    template <typename Visit>
+    void rangeCells(const Cell & cell, const Rect & rect, Visit && visit) const;
+    void searchNearest(const Cell & cell, const Point & p, std::size_t k, std::vector<std::pair<double, const Point *>> & best) const;
+};
+
+} // namespace quadtree
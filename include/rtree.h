@@ -0,0 +1,74 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace rtree {
+
+// Static R-tree bulk-loaded with Sort-Tile-Recursive packing. Nodes live in one flat array,
+// children of a node are adjacent, and the child boxes of a node are stored as separate
+// coordinate arrays, so testing all children of a node touches four cache lines.
+class PointSet
+{
+public:
+    using iterator = std::vector<Point>::const_iterator;
+
+    PointSet(const std::string & filename = {});
+    PointSet(std::vector<Point> points);
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    friend std::ostream & operator<<(std::ostream &, const PointSet &);
+
+private:
+    // 8 doubles per coordinate array fill exactly one 64 byte cache line
+    static constexpr std::size_t fanout = 8;
+
+    struct Node
+    {
+        alignas(64) std::array<double, fanout> xmin;
+        std::array<double, fanout> ymin;
+        std::array<double, fanout> xmax;
+        std::array<double, fanout> ymax;
+        // index of the first child in m_nodes, or of the first point group for leaves
+        std::size_t first = 0;
+        std::size_t count = 0;
+        bool leaf = false;
+    };
+
+    // indexed points in STR order followed by points added by put() since the last rebuild;
+    // leaf child `g` is the group m_points[g * fanout] .. m_points[min((g + 1) * fanout, m_indexed)]
+    std::vector<Point> m_points;
+    std::vector<Node> m_nodes;
+    std::size_t m_indexed = 0;
+
+    // bounded max-heap of (squared distance, point index)
+    struct Candidates
+    {
+        std::size_t k;
+        std::vector<std::pair<double, std::size_t>> heap;
+        double bound() const;
+        void offer(double dist, std::size_t index);
+    };
+
+    void reBuild();
+    std::pair<std::size_t, std::size_t> group(std::size_t g) const;
+    void searchNearest(std::size_t node, const Point & p, Candidates & best) const;
+    // k best candidates by squared distance, nearest first
+    std::vector<std::size_t> nearestIndices(const Point & p, std::size_t k) const;
+};
+
+} // namespace rtree
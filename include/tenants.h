@@ -0,0 +1,91 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace tenants {
+
+// Names one point set of a Registry. A handle outlives the set it named: once the set is
+// removed, the handle is stale and every query through it answers as for an empty set, even
+// after the slot is reused.
+struct Handle
+{
+    std::uint32_t slot = 0;
+    std::uint32_t generation = 0;
+
+    bool operator==(const Handle &) const = default;
+};
+
+struct Options
+{
+    // sets smaller than this are scanned with the batch kernels instead of searched as a tree
+    std::size_t brute_force_below = 64;
+    // tree ranges of at most this many points are scanned as well
+    std::size_t leaf_size = 8;
+};
+
+// Many small static point sets packed into one shared arena. Every set is a contiguous slice of
+// the arena laid out as an implicit kd-tree: the median along the split axis sits in the middle
+// of its range, with the points on either side of it in the two halves, so a set costs its
+// points and a 16 byte slot and no nodes. Equal points are dropped as in the other backends.
+// Sets below Options::brute_force_below are scanned with kernels::contains and
+// kernels::distances, so their range() takes the borders exactly rather than within epsilon.
+//
+// Queries may run concurrently with each other; add(), remove() and compact() need exclusive
+// access.
+class Registry
+{
+public:
+    explicit Registry(const Options & options = {});
+
+    Handle add(std::vector<Point> points);
+    // false if the handle was already stale
+    bool remove(Handle handle);
+    bool valid(Handle handle) const;
+    // live sets
+    std::size_t tenants() const;
+
+    std::size_t size(Handle handle) const;
+    bool contains(Handle handle, const Point & p) const;
+    PointView range(Handle handle, const Rect & rect) const;
+    std::optional<Point> nearest(Handle handle, const Point & p) const;
+    PointView nearest(Handle handle, const Point & p, std::size_t k) const;
+    // the points of the set in arena order, valid until the next add(), remove() or compact()
+    std::span<const Point> points(Handle handle) const;
+
+    // bytes the set accounts for: its points and its slot
+    MemoryUsage memoryUsage(Handle handle) const;
+    // the whole arena, the slot table and the free list, with the capacity they hold
+    MemoryUsage memoryUsage() const;
+    // arena bytes still held by removed sets
+    std::size_t wasted() const;
+    // moves the live sets together and releases the holes; remove() does this on its own once
+    // the holes outweigh the live points
+    void compact();
+
+private:
+    struct Slot
+    {
+        std::uint64_t offset = 0;
+        std::uint32_t size = 0;
+        // odd while the slot is free, so that no handle matches it
+        std::uint32_t generation = 0;
+    };
+
+    Options m_options;
+    std::vector<Point> m_arena;
+    std::vector<Slot> m_slots;
+    // slots of removed sets, reused by add()
+    std::vector<std::uint32_t> m_free;
+    std::size_t m_live_points = 0;
+
+    const Slot * find(Handle handle) const;
+    bool bruteForce(const Slot & slot) const;
+    void build(Point * begin, Point * end, std::size_t axis) const;
+};
+
+} // namespace tenants
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace trace {
+
+// Tracing policies receive begin/end pairs around spans and instant events at single points.
+// Event names must be string literals or otherwise outlive the policy's buffers.
+
+// Default policy: every call is empty and inlines to nothing.
+struct NoTrace
+{
+    static void begin(const char *)
+    {
+    }
+    static void end(const char *)
+    {
+    }
+    static void instant(const char *)
+    {
+    }
+};
+
+// Records events into a ring buffer of the calling thread, without locks once the thread has
+// registered its buffer, and writes them as a Chrome trace-event JSON file (chrome://tracing,
+// Perfetto). When a thread records more than ring_capacity events only the newest are kept.
+class ChromeTrace
+{
+public:
+    static constexpr std::size_t ring_capacity = std::size_t{1} << 16;
+
+    static void begin(const char * name);
+    static void end(const char * name);
+    static void instant(const char * name);
+
+    // writes the buffered events of all threads, including exited ones, false if the file
+    // cannot be written; best called while no thread is recording
+    static bool write(const std::string & filename);
+    // drops all buffered events
+    static void clear();
+};
+
+// begin() on construction and end() on destruction
+template <typename Policy>
+class Scope
+{
+public:
+    explicit Scope(const char * name)
+        : m_name(name)
+    {
+        Policy::begin(name);
+    }
+    ~Scope()
+    {
+        Policy::end(m_name);
+    }
+    Scope(const Scope &) = delete;
+    Scope & operator=(const Scope &) = delete;
+
+private:
+    const char * m_name;
+};
+
+} // namespace trace
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace vptree {
+
+struct Euclidean
+{
+    static double distance(const Point & lhs, const Point & rhs);
+    // radius of a ball around the centre of `rect` that contains the whole rectangle
+    static double enclosingRadius(const Rect & rect, const Point & centre);
+};
+
+// great-circle distance in kilometres between points given as (longitude, latitude) in degrees
+struct Haversine
+{
+    static constexpr double earth_radius = 6371.0088;
+
+    static double distance(const Point & lhs, const Point & rhs);
+    static double enclosingRadius(const Rect & rect, const Point & centre);
+};
+
+// Vantage-point tree. It prunes with the triangle inequality only, so it works for any metric,
+// including ones that are not aligned with the coordinate axes. The tree is implicit in the
+// point order: the node at index i with subtree [i, last) has its inside subtree at
+// [i + 1, middle) and its outside subtree at [middle, last), and m_radius[i] holds the split.
+// Instantiated in vptree.cpp for Euclidean and Haversine.
+template <typename Metric = Euclidean>
+class PointSet
+{
+public:
+    using iterator = std::vector<Point>::const_iterator;
+
+    PointSet(const std::string & filename = {});
+    PointSet(std::vector<Point> points);
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+    // points within `distance` of p, inclusive
+    PointView radius(const Point & p, double distance) const;
+
+    friend std::ostream & operator<<(std::ostream & strm, const PointSet & points)
+    {
+        for (auto it = points.begin(); it != points.end(); it++) {
+            strm << *it;
+        }
+        return strm;
+    }
+
+private:
+    static constexpr std::size_t leaf_size = 8;
+
+    // indexed points in tree order followed by points added by put() since the last rebuild
+    std::vector<Point> m_points;
+    std::vector<double> m_radius;
+    std::size_t m_indexed = 0;
+
+    void reBuild();
+    void buildTree(std::size_t first, std::size_t last);
+    static std::size_t middle(std::size_t first, std::size_t last);
+    template <typename Visit>
+    void searchRadius(std::size_t first, std::size_t last, const Point & p, double distance, Visit && visit) const;
+    void searchNearest(std::size_t first, std::size_t last, const Point & p, std::size_t k, std::vector<std::pair<double, std::size_t>> & best) const;
+    std::vector<std::pair<double, std::size_t>> nearestIndices(const Point & p, std::size_t k) const;
+};
+
+extern template class PointSet<Euclidean>;
+extern template class PointSet<Haversine>;
+
+} // namespace vptree
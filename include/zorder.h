@@ -0,0 +1,91 @@
+#pragma once
+
+#include "primitives.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace zorder {
+
+// position lookups in the sorted code array by plain binary search
+struct BinarySearch
+{
+    void build(const std::vector<std::uint64_t> &)
+    {
+    }
+    // first index in [first, last) whose code is not less than `code`
+    std::size_t lowerBound(const std::vector<std::uint64_t> & codes, std::uint64_t code, std::size_t first, std::size_t last) const;
+};
+
+// Static index: points sorted by the Morton code of their quantized coordinates in one flat
+// array. A rectangle is split into Morton intervals with LITMAX/BIGMIN until an interval is
+// either entirely inside the rectangle or holds few points; each interval is then one
+// lower bound search followed by a sequential scan. `Search` finds positions in the code
+// array; it is instantiated in zorder.cpp for BinarySearch and learned::Model.
+template <typename Search = BinarySearch>
+class PointSet
+{
+public:
+    using iterator = std::vector<Point>::const_iterator;
+
+    PointSet(const std::string & filename = {});
+    PointSet(std::vector<Point> points);
+    bool empty() const;
+    std::size_t size() const;
+    void put(const Point &);
+    bool contains(const Point &) const;
+
+    PointView range(const Rect &) const;
+    iterator begin() const;
+    iterator end() const;
+
+    std::optional<Point> nearest(const Point &) const;
+    PointView nearest(const Point & p, std::size_t k) const;
+
+    friend std::ostream & operator<<(std::ostream & strm, const PointSet & points)
+    {
+        for (auto it = points.begin(); it != points.end(); it++) {
+            strm << *it;
+        }
+        return strm;
+    }
+
+private:
+    // intervals holding at most this many points are scanned instead of split further
+    static constexpr std::size_t scan_threshold = 64;
+
+    // quantized query box, bounds inclusive
+    struct Box
+    {
+        std::uint32_t x0, y0, x1, y1;
+    };
+
+    // indexed points sorted by m_codes, followed by points added by put() since the last rebuild
+    std::vector<Point> m_points;
+    std::vector<std::uint64_t> m_codes;
+    std::size_t m_indexed = 0;
+    Search m_search;
+    double m_xmin = 0;
+    double m_ymin = 0;
+    double m_xmax = 0;
+    double m_ymax = 0;
+    double m_xscale = 0;
+    double m_yscale = 0;
+
+    void reBuild();
+    std::size_t lowerBound(std::uint64_t code, std::size_t first, std::size_t last) const;
+    std::size_t upperBound(std::uint64_t code, std::size_t first, std::size_t last) const;
+    std::uint32_t quantizeX(double x) const;
+    std::uint32_t quantizeY(double y) const;
+    std::uint64_t code(const Point & p) const;
+    std::optional<Box> quantize(const Rect & rect) const;
+    // calls visit(first, last) for index runs of m_points covering every indexed point in box
+    template <typename Visit>
+    void intervals(const Box & box, std::size_t first, std::size_t last, Visit && visit) const;
+};
+
+extern template class PointSet<BinarySearch>;
+
+} // namespace zorder
@@ -1,7 +1,11 @@
 #include "primitives.h"
 
+#include "latency.h"
+#include "trace.h"
+
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -19,14 +23,15 @@ double Point::distance(const Point & other) const
                      std::pow(y_coord - other.y(), 2));
 }
 
+// lexicographic, so that std::set<Point> gets a strict weak ordering
 bool Point::operator<(const Point & p) const
 {
-    return x_coord < p.x() || y_coord < p.y();
+    return x_coord < p.x() || (x_coord == p.x() && y_coord < p.y());
 }
 
 bool Point::operator>(const Point & p) const
 {
-    return x_coord > p.x() || y_coord > p.y();
+    return p < *this;
 }
 
 bool Point::operator<=(const Point & p) const
@@ -88,13 +93,34 @@ bool Rect::intersects(const Rect & rect) const
     return false;
 }
 
-namespace rbtree {
+namespace {
 
-PointSet::PointSet(const std::string & filename)
+// bytes a glibc-style malloc takes for a request: a size word, 16 byte granularity and a
+// minimum chunk of four words
+std::size_t chunkSize(std::size_t bytes)
+{
+    return std::max(4 * sizeof(void *), (bytes + sizeof(void *) + 15) & ~std::size_t{15});
+}
+
+// layout of the standard library's internal objects, as in libstdc++: red-black tree nodes
+// start with a colour and three links, shared_ptr control blocks are a vtable pointer and two
+// 32-bit counts
+constexpr std::size_t rb_node_header = 4 * sizeof(void *);
+constexpr std::size_t control_block = sizeof(void *) + 2 * sizeof(std::int32_t);
+
+} // anonymous namespace
+
+std::size_t MemoryUsage::total() const
+{
+    return nodes + points + control_blocks + summaries;
+}
+
+std::vector<Point> readPoints(const std::string & filename)
 {
+    std::vector<Point> points;
     std::ifstream fs(filename);
-    if (!fs.good()) {
-        return;
+    if (!fs.is_open()) {
+        return points;
     }
     double x, y;
     while (fs) {
@@ -102,9 +128,27 @@ PointSet::PointSet(const std::string & filename)
         if (fs.fail()) {
             break;
         }
-        m_set.insert(Point(x, y));
+        points.emplace_back(x, y);
+    }
+    return points;
+}
+
+std::vector<Point> uniquePoints(std::vector<Point> points)
+{
+    std::sort(points.begin(), points.end(), [](const Point & lhs, const Point & rhs) {
+        return lhs.x() < rhs.x() || (lhs.x() == rhs.x() && lhs.y() < rhs.y());
+    });
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    return points;
+}
+
+namespace rbtree {
+
+PointSet::PointSet(const std::string & filename)
+{
+    for (const auto & p : readPoints(filename)) {
+        m_set.insert(p);
     }
-    fs.close();
 }
 
 bool PointSet::empty() const
@@ -119,11 +163,13 @@ std::size_t PointSet::size() const
 
 void PointSet::put(const Point & p)
 {
+    latency::Timer timer(latency::Operation::put);
     m_set.insert(p);
 }
 
 bool PointSet::contains(const Point & p) const
 {
+    latency::Timer timer(latency::Operation::contains);
     return m_set.find(p) != m_set.end();
 }
 
@@ -132,20 +178,30 @@ PointSet::PointSet(const std::set<Point> & set)
 {
 }
 
-std::pair<PointSet::iterator, PointSet::iterator> PointSet::range(const Rect & rect) const
+MemoryUsage PointSet::memoryUsage() const
+{
+    // points live inside the tree nodes, so only the header and overhead count as node bytes
+    MemoryUsage usage;
+    usage.points = m_set.size() * sizeof(Point);
+    usage.nodes = m_set.size() * (chunkSize(rb_node_header + sizeof(Point)) - sizeof(Point));
+    return usage;
+}
+
+PointView PointSet::range(const Rect & rect) const
 {
-    auto in_rect = std::make_shared<std::vector<Point>>();
+    latency::Timer timer(latency::Operation::range);
+    std::vector<Point> in_rect;
     for (auto it = begin(); it != end(); it++) {
         if (rect.contains(*it)) {
-            in_rect->push_back(*it);
+            in_rect.push_back(*it);
         }
     }
-    return {iterator(in_rect), iterator(in_rect->end())};
+    return PointView(std::move(in_rect));
 }
 
 PointSet::iterator PointSet::begin() const
 {
-    return rbtree::PointSet::iterator(*this);
+    return PointSet::iterator(m_set.begin());
 }
 
 PointSet::iterator PointSet::end() const
@@ -155,31 +211,36 @@ PointSet::iterator PointSet::end() const
 
 std::optional<Point> PointSet::nearest(const Point & point) const
 {
+    latency::Timer timer(latency::Operation::nearest);
+    if (m_set.empty()) {
+        return std::nullopt;
+    }
     return *std::min_element(begin(), end(), [&point](const Point & a, const Point & b) { return a.distance(point) < b.distance(point); });
 }
 
-std::pair<PointSet::iterator, PointSet::iterator> PointSet::nearest(const Point & point, std::size_t k) const
+PointView PointSet::nearest(const Point & point, std::size_t k) const
 {
+    latency::Timer timer(latency::Operation::knn);
     if (k >= m_set.size()) {
-        return {begin(), end()};
+        return PointView(std::vector<Point>(begin(), end()));
     }
     if (k == 0) {
-        return {begin(), begin()};
+        return {};
     }
-    auto neighbours = std::make_shared<std::vector<Point>>();
-    neighbours->reserve(k);
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
     for (auto it = begin(); it != end(); it++) {
-        if (neighbours->size() < k) {
-            neighbours->push_back(*it);
+        if (neighbours.size() < k) {
+            neighbours.push_back(*it);
         }
         else {
-            auto max_distanced = std::max_element(neighbours->begin(), neighbours->end(), [&point](const Point & lhs, const Point & rhs) { return lhs.distance(point) <= rhs.distance(point); });
+            auto max_distanced = std::max_element(neighbours.begin(), neighbours.end(), [&point](const Point & lhs, const Point & rhs) { return lhs.distance(point) <= rhs.distance(point); });
             if (it->distance(point) < max_distanced->distance(point)) {
                 *max_distanced = *it;
             }
         }
     }
-    return {{neighbours}, {neighbours->end()}};
+    return PointView(std::move(neighbours));
 }
 
 std::ostream & operator<<(std::ostream & strm, const rbtree::PointSet & points)
@@ -194,23 +255,163 @@ std::ostream & operator<<(std::ostream & strm, const rbtree::PointSet & points)
 
 namespace kdtree {
 
-PointSet::PointSet(const std::string & filename)
+namespace {
+
+template <std::size_t Axis>
+double coord(const Point & p)
 {
-    std::ifstream fs(filename);
-    if (!fs.is_open()) {
-        return;
+    if constexpr (Axis == 0) {
+        return p.x();
     }
-    std::vector<Point> points;
-    double x, y;
-    while (fs) {
-        fs >> x >> y;
-        if (fs.fail()) {
-            break;
+    else {
+        return p.y();
+    }
+}
+
+// compares squared lengths, which keeps sqrt out of the traversal
+struct SquaredEuclidean
+{
+    static double distance(const Point & lhs, const Point & rhs)
+    {
+        return squaredDistance(lhs, rhs);
+    }
+    static double planeDistance(double delta)
+    {
+        return delta * delta;
+    }
+};
+
+struct CollectInto
+{
+    std::vector<Point> & points;
+    void operator()(const Point & p)
+    {
+        points.push_back(p);
+    }
+};
+
+// collects the points of the bounding square of a circle that lie in the circle
+struct CollectWithin
+{
+    std::vector<Point> & points;
+    const Point & center;
+    double squared_radius;
+    void operator()(const Point & p)
+    {
+        if (squaredDistance(center, p) <= squared_radius) {
+            points.push_back(p);
         }
-        points.emplace_back(Point(x, y));
     }
-    fs.close();
+};
+
+// traversal hooks of the query kernels when nobody asked for counters; the calls compile away
+struct NoStats
+{
+    void visit(std::size_t, bool)
+    {
+    }
+    void distance()
+    {
+    }
+    void prune()
+    {
+    }
+    void result(std::size_t)
+    {
+    }
+};
+
+struct CountInto
+{
+    QueryStats & stats;
+    void visit(std::size_t depth, bool leaf)
+    {
+        ++stats.nodes_visited;
+        stats.leaves_visited += leaf;
+        stats.max_depth = std::max(stats.max_depth, depth);
+    }
+    void distance()
+    {
+        ++stats.distance_evaluations;
+    }
+    void prune()
+    {
+        ++stats.subtrees_pruned;
+    }
+    void result(std::size_t count)
+    {
+        stats.results += count;
+    }
+};
+
+// average search path of a tree of `size` nodes with every level but the last one full
+double balancedPath(std::size_t size)
+{
+    std::size_t total = 0, placed = 0;
+    for (std::size_t depth = 0; placed < size; ++depth) {
+        std::size_t level = std::min(size - placed, std::size_t{1} << std::min<std::size_t>(depth, 63));
+        total += level * (depth + 1);
+        placed += level;
+    }
+    return size == 0 ? 0 : static_cast<double>(total) / size;
+}
+
+thread_local QueryStats thread_stats;
+
+// hooks for queries made without a stats argument
+#ifdef KDTREE_QUERY_STATS
+CountInto threadCounter()
+{
+    return {thread_stats};
+}
+#else
+NoStats threadCounter()
+{
+    return {};
+}
+#endif
+
+// receives the build, rebuild, insert and query events; NoTrace compiles away
+#ifdef KDTREE_TRACE
+using Tracer = trace::ChromeTrace;
+#else
+using Tracer = trace::NoTrace;
+#endif
+using TraceScope = trace::Scope<Tracer>;
+
+} // anonymous namespace
+
+QueryStats & QueryStats::operator+=(const QueryStats & other)
+{
+    nodes_visited += other.nodes_visited;
+    leaves_visited += other.leaves_visited;
+    distance_evaluations += other.distance_evaluations;
+    subtrees_pruned += other.subtrees_pruned;
+    results += other.results;
+    max_depth = std::max(max_depth, other.max_depth);
+    return *this;
+}
+
+QueryStats PointSet::threadStats()
+{
+    return thread_stats;
+}
+
+void PointSet::resetThreadStats()
+{
+    thread_stats = {};
+}
+
+PointSet::PointSet(const std::string & filename)
+    : PointSet(readPoints(filename))
+{
+}
+
+PointSet::PointSet(std::vector<Point> points)
+{
+    TraceScope scope("kdtree::buildTree");
     buildTree(this, points, 0, points.size(), 0);
+    m_built_ratio = pathRatio();
 }
 
 void PointSet::buildTree(PointSet * tree, std::vector<Point> & points, std::size_t start, std::size_t end, std::size_t depth) const
@@ -218,14 +419,24 @@ void PointSet::buildTree(PointSet * tree, std::vector<Point> & points, std::size
     if (end - start < 1) {
         return;
     }
-    std::size_t middle = (end + start) / 2;
-    auto m = points.begin() + middle;
-    std::nth_element(points.begin() + start, m, points.begin() + end, [&depth](const Point & lhs, const Point & rhs) {
-        return (depth % 2 == 0) ? (lhs.x() < rhs.x()) : (lhs.y() < rhs.y());
-    });
-    tree->m_root = tree->insert(*m, tree->m_root, 0);
-    buildTree(tree, points, start, middle, depth + 1);
-    buildTree(tree, points, middle + 1, end, depth + 1);
+    auto key = [&depth](const Point & p) { return (depth % 2 == 0) ? p.x() : p.y(); };
+    auto first = points.begin() + start, last = points.begin() + end;
+    auto m = points.begin() + (end + start) / 2;
+    std::nth_element(first, m, last, [&key](const Point & lhs, const Point & rhs) { return key(lhs) < key(rhs); });
+    // insert() sends points equal to a node along its axis to the left, so the split has to
+    // fall on either side of the run of points equal to the median, whichever is closer
+    double median = key(*m);
+    auto less = std::partition(first, m, [&key, median](const Point & p) { return key(p) < median; });
+    auto equal = std::partition(m, last, [&key, median](const Point & p) { return key(p) == median; });
+    auto root = equal - 1;
+    auto half = (last - first - 1) / 2;
+    if (less != first && std::abs((less - 1 - first) - half) < std::abs((equal - 1 - first) - half)) {
+        std::iter_swap(std::max_element(first, less, [&key](const Point & lhs, const Point & rhs) { return key(lhs) < key(rhs); }), less - 1);
+        root = less - 1;
+    }
+    tree->m_root = tree->insert(*root, tree->m_root, 0);
+    buildTree(tree, points, start, root - points.begin(), depth + 1);
+    buildTree(tree, points, root - points.begin() + 1, end, depth + 1);
 }
 
 bool PointSet::empty() const
@@ -238,6 +449,19 @@ std::size_t PointSet::size() const
     return m_size;
 }
 
+MemoryUsage PointSet::memoryUsage() const
+{
+    // make_shared puts the control block and the node in one allocation, the point is a
+    // separate one owned by the node
+    MemoryUsage usage;
+    usage.control_blocks = m_size * control_block;
+    usage.nodes = m_size * (chunkSize(control_block + sizeof(Node)) - control_block);
+    usage.points = m_size * chunkSize(sizeof(Point));
+    // reBuild copies the points out of the tree before it frees the nodes
+    usage.scratch = m_size == 0 ? 0 : chunkSize(m_size * sizeof(Point));
+    return usage;
+}
+
 const PointSet::NodePtr & PointSet::insert(const Point & point, NodePtr & node, std::size_t depth)
 {
     max_depth = std::max(max_depth, depth);
@@ -245,6 +469,7 @@ const PointSet::NodePtr & PointSet::insert(const Point & point, NodePtr & node,
         node = std::make_shared<Node>(point);
         node->depth = depth;
         ++m_size;
+        m_total_depth += depth;
         return node;
     }
     if (*node->m_point == point) {
@@ -262,70 +487,214 @@ const PointSet::NodePtr & PointSet::insert(const Point & point, NodePtr & node,
     return node;
 }
 
+double PointSet::pathRatio() const
+{
+    return m_size == 0 ? 1 : (static_cast<double>(m_total_depth) / m_size + 1) / balancedPath(m_size);
+}
+
+bool PointSet::needsRebuild() const
+{
+    if (m_size < std::max<std::size_t>(m_policy.min_size, 2)) {
+        return false;
+    }
+    if (pathRatio() > m_policy.max_path_ratio * m_built_ratio) {
+        return true;
+    }
+    return m_policy.max_depth_ratio > 0 && max_depth > m_policy.max_depth_ratio * std::log2(m_size);
+}
+
 void PointSet::reBuild()
 {
-    if (max_depth > 2 * std::log(m_size)) {
+    if (needsRebuild()) {
+        Tracer::instant("kdtree::reBuild");
+        latency::Timer timer(latency::Operation::rebuild);
         std::vector<Point> points;
         points.reserve(m_size);
         for (auto it = begin(); it != end(); it++) {
             points.emplace_back(it->x(), it->y());
         }
         m_size = 0;
+        m_total_depth = 0;
         max_depth = 0;
         m_root = nullptr;
+        TraceScope scope("kdtree::buildTree");
         buildTree(this, points, 0, points.size(), 0);
+        m_built_ratio = pathRatio();
     }
 }
 
+const RebuildPolicy & PointSet::rebuildPolicy() const
+{
+    return m_policy;
+}
+
+void PointSet::setRebuildPolicy(const RebuildPolicy & policy)
+{
+    m_policy = policy;
+}
+
+std::size_t PointSet::measureShape(const NodePtr & node, TreeShape & shape, std::vector<std::size_t> & inner)
+{
+    if (node == nullptr) {
+        return 0;
+    }
+    if (shape.depth_histogram.size() <= node->depth) {
+        shape.depth_histogram.resize(node->depth + 1, 0);
+        shape.level_imbalance.resize(node->depth + 1, 0);
+        inner.resize(node->depth + 1, 0);
+    }
+    ++shape.depth_histogram[node->depth];
+    shape.average_path += node->depth + 1;
+    std::size_t left = measureShape(node->left, shape, inner);
+    std::size_t right = measureShape(node->right, shape, inner);
+    if (left + right > 0) {
+        ++inner[node->depth];
+        shape.level_imbalance[node->depth] += std::abs(static_cast<double>(left) - static_cast<double>(right)) / (left + right);
+    }
+    return left + right + 1;
+}
+
+TreeShape PointSet::shape() const
+{
+    TreeShape shape;
+    std::vector<std::size_t> inner;
+    shape.size = measureShape(m_root, shape, inner);
+    shape.max_depth = shape.depth_histogram.empty() ? 0 : shape.depth_histogram.size() - 1;
+    for (std::size_t depth = 0; depth < inner.size(); ++depth) {
+        if (inner[depth] > 0) {
+            shape.level_imbalance[depth] /= inner[depth];
+        }
+    }
+    if (shape.size > 0) {
+        shape.average_path /= shape.size;
+    }
+    shape.balanced_path = balancedPath(shape.size);
+    return shape;
+}
+
 void PointSet::put(const Point & p)
 {
+    latency::Timer timer(latency::Operation::put);
+    TraceScope scope("kdtree::insert");
     m_root = insert(p, m_root, 0);
     reBuild();
 }
 
-const PointSet::NodePtr & PointSet::find(const Point & p, const NodePtr & node) const
+template <typename Stats>
+const PointSet::NodePtr & PointSet::find(const Point & p, const NodePtr & node, Stats & stats)
 {
     if (node == nullptr) {
         return node;
     }
+    stats.visit(node->depth, node->left == nullptr && node->right == nullptr);
+    stats.distance();
     if (*node->m_point == p) {
         return node;
     }
     bool toLeft = (node->depth % 2 == 0) ? (p.x() <= node->m_point->x()) : (p.y() <= node->m_point->y());
     if (toLeft) {
-        return find(p, node->left);
+        return find(p, node->left, stats);
     }
-    return find(p, node->right);
+    return find(p, node->right, stats);
 }
 
 bool PointSet::contains(const Point & p) const
 {
-    return find(p, m_root) != nullptr;
+    latency::Timer timer(latency::Operation::contains);
+    TraceScope scope("kdtree::contains");
+    auto stats = threadCounter();
+    bool found = find(p, m_root, stats) != nullptr;
+    stats.result(found);
+    return found;
+}
+
+bool PointSet::contains(const Point & p, QueryStats & stats) const
+{
+    latency::Timer timer(latency::Operation::contains);
+    TraceScope scope("kdtree::contains");
+    CountInto count{stats};
+    bool found = find(p, m_root, count) != nullptr;
+    count.result(found);
+    return found;
 }
 
-void PointSet::findPointsInRectangle(const NodePtr & node, std::vector<Point> & points, const Rect & rect) const
+template <std::size_t Axis, typename Output, typename Stats>
+void PointSet::findPointsInRectangle(const NodePtr & node, Output & out, const Rect & rect, Stats & stats)
 {
     if (node == nullptr) {
         return;
     }
-    if (rect.contains(*node->m_point)) {
-        points.push_back(*node->m_point);
+    stats.visit(node->depth, node->left == nullptr && node->right == nullptr);
+    const Point & point = *node->m_point;
+    stats.distance();
+    if (rect.contains(point)) {
+        out(point);
     }
-    bool toLeft = (node->depth % 2 == 0) ? (node->m_point->x() >= rect.xmin()) : (node->m_point->y() >= rect.ymin());
-    bool toRight = (node->depth % 2 == 0) ? (node->m_point->x() <= rect.xmax()) : (node->m_point->y() <= rect.ymax());
-    if (toLeft) {
-        findPointsInRectangle(node->left, points, rect);
+    if (coord<Axis>(point) >= rect.min<Axis>()) {
+        findPointsInRectangle<1 - Axis>(node->left, out, rect, stats);
+    }
+    else if (node->left != nullptr) {
+        stats.prune();
+    }
+    if (coord<Axis>(point) <= rect.max<Axis>()) {
+        findPointsInRectangle<1 - Axis>(node->right, out, rect, stats);
     }
-    if (toRight) {
-        findPointsInRectangle(node->right, points, rect);
+    else if (node->right != nullptr) {
+        stats.prune();
+    }
+}
+
+template <typename Stats>
+PointView PointSet::rangeWith(const Rect & rect, Stats & stats) const
+{
+    latency::Timer timer(latency::Operation::range);
+    TraceScope scope("kdtree::range");
+    std::vector<Point> in_rect;
+    CollectInto collect{in_rect};
+    findPointsInRectangle<0>(m_root, collect, rect, stats);
+    stats.result(in_rect.size());
+    return PointView(std::move(in_rect));
+}
+
+PointView PointSet::range(const Rect & rect) const
+{
+    auto stats = threadCounter();
+    return rangeWith(rect, stats);
+}
+
+PointView PointSet::range(const Rect & rect, QueryStats & stats) const
+{
+    CountInto count{stats};
+    return rangeWith(rect, count);
+}
+
+template <typename Stats>
+PointView PointSet::withinWith(const Point & center, double radius, Stats & stats) const
+{
+    latency::Timer timer(latency::Operation::range);
+    TraceScope scope("kdtree::within");
+    // also turns away a NaN radius
+    if (!(radius >= 0)) {
+        return {};
     }
+    std::vector<Point> in_circle;
+    CollectWithin collect{in_circle, center, radius * radius};
+    Rect square(Point(center.x() - radius, center.y() - radius), Point(center.x() + radius, center.y() + radius));
+    findPointsInRectangle<0>(m_root, collect, square, stats);
+    stats.result(in_circle.size());
+    return PointView(std::move(in_circle));
 }
 
-std::pair<PointSet::iterator, PointSet::iterator> PointSet::range(const Rect & rect) const
+PointView PointSet::within(const Point & center, double radius) const
 {
-    auto in_rect = std::make_shared<std::vector<Point>>();
-    findPointsInRectangle(m_root, *in_rect, rect);
-    return {{in_rect}, {in_rect->end()}};
+    auto stats = threadCounter();
+    return withinWith(center, radius, stats);
+}
+
+PointView PointSet::within(const Point & center, double radius, QueryStats & stats) const
+{
+    CountInto count{stats};
+    return withinWith(center, radius, count);
 }
 
 PointSet::iterator PointSet::begin() const
@@ -338,61 +707,129 @@ PointSet::iterator PointSet::end() const
     return {*this};
 }
 
-void PointSet::findNeighbour(const NodePtr & node, const Point & point, Point & closest_found) const
+template <std::size_t Axis, typename Metric, typename Stats>
+void PointSet::findNeighbour(const NodePtr & node, const Point & point, const Point *& closest_found, double & best, Stats & stats)
 {
     if (node == nullptr) {
         return;
     }
-    double dist = node->m_point->distance(point);
-    if (dist < point.distance(closest_found)) {
-        closest_found = *node->m_point;
+    stats.visit(node->depth, node->left == nullptr && node->right == nullptr);
+    const Point & candidate = *node->m_point;
+    double dist = Metric::distance(candidate, point);
+    stats.distance();
+    if (dist < best) {
+        best = dist;
+        closest_found = &candidate;
     }
     if (dist == 0) {
+        stats.prune();
         return;
     }
-    double delta;
-    if (node->depth % 2 == 0) {
-        delta = node->m_point->x() - point.x();
+    double delta = coord<Axis>(candidate) - coord<Axis>(point);
+    findNeighbour<1 - Axis, Metric>((delta > 0) ? node->left : node->right, point, closest_found, best, stats);
+    const NodePtr & far = (delta > 0) ? node->right : node->left;
+    if (Metric::planeDistance(delta) >= best) {
+        if (far != nullptr) {
+            stats.prune();
+        }
+        return;
     }
-    else {
-        delta = node->m_point->y() - point.y();
+    findNeighbour<1 - Axis, Metric>(far, point, closest_found, best, stats);
+}
+
+template <std::size_t Axis, typename Metric, typename Stats>
+void PointSet::findNeighbours(const NodePtr & node, const Point & point, std::size_t k, std::vector<std::pair<double, const Point *>> & best, Stats & stats)
+{
+    if (node == nullptr) {
+        return;
     }
-    findNeighbour((delta > 0) ? node->left : node->right, point, closest_found);
-    if (std::abs(delta) >= point.distance(closest_found)) {
+    stats.visit(node->depth, node->left == nullptr && node->right == nullptr);
+    const Point & candidate = *node->m_point;
+    double dist = Metric::distance(candidate, point);
+    stats.distance();
+    if (best.size() < k || dist < best.front().first) {
+        if (best.size() == k) {
+            std::pop_heap(best.begin(), best.end());
+            best.pop_back();
+        }
+        best.emplace_back(dist, &candidate);
+        std::push_heap(best.begin(), best.end());
+    }
+    double delta = coord<Axis>(candidate) - coord<Axis>(point);
+    findNeighbours<1 - Axis, Metric>((delta > 0) ? node->left : node->right, point, k, best, stats);
+    const NodePtr & far = (delta > 0) ? node->right : node->left;
+    if (best.size() == k && Metric::planeDistance(delta) >= best.front().first) {
+        if (far != nullptr) {
+            stats.prune();
+        }
         return;
     }
-    findNeighbour((delta > 0) ? node->right : node->left, point, closest_found);
+    findNeighbours<1 - Axis, Metric>(far, point, k, best, stats);
+}
+
+template <typename Stats>
+std::optional<Point> PointSet::nearestWith(const Point & point, Stats & stats) const
+{
+    latency::Timer timer(latency::Operation::nearest);
+    TraceScope scope("kdtree::nearest");
+    if (m_root == nullptr) {
+        return std::nullopt;
+    }
+    const Point * closest_point = m_root->m_point.get();
+    double best = SquaredEuclidean::distance(*closest_point, point);
+    stats.distance();
+    findNeighbour<0, SquaredEuclidean>(m_root, point, closest_point, best, stats);
+    stats.result(1);
+    return std::optional<Point>(*closest_point);
 }
 
 std::optional<Point> PointSet::nearest(const Point & point) const
 {
-    Point closest_point(*m_root->m_point);
-    findNeighbour(m_root, point, closest_point);
-    return std::optional<Point>(closest_point);
+    auto stats = threadCounter();
+    return nearestWith(point, stats);
 }
 
-std::pair<PointSet::iterator, PointSet::iterator> PointSet::nearest(const Point & p, std::size_t k) const
+std::optional<Point> PointSet::nearest(const Point & point, QueryStats & stats) const
 {
+    CountInto count{stats};
+    return nearestWith(point, count);
+}
+
+template <typename Stats>
+PointView PointSet::nearestWith(const Point & p, std::size_t k, Stats & stats) const
+{
+    latency::Timer timer(latency::Operation::knn);
+    TraceScope scope("kdtree::knn");
     if (k >= m_size) {
-        return {begin(), end()};
+        stats.result(m_size);
+        return PointView(std::vector<Point>(begin(), end()));
     }
     if (k == 0) {
-        return {begin(), begin()};
+        return {};
     }
-    auto neighbours = std::make_shared<std::vector<Point>>();
-    neighbours->reserve(k);
-    for (auto it = begin(); it != end(); it++) {
-        if (neighbours->size() < k) {
-            neighbours->push_back(*it);
-        }
-        else {
-            auto max_distanced = std::max_element(neighbours->begin(), neighbours->end(), [&p](const Point & lhs, const Point & rhs) { return lhs.distance(p) <= rhs.distance(p); });
-            if (it->distance(p) < max_distanced->distance(p)) {
-                *max_distanced = *it;
-            }
-        }
+    std::vector<std::pair<double, const Point *>> best;
+    best.reserve(k + 1);
+    findNeighbours<0, SquaredEuclidean>(m_root, p, k, best, stats);
+    std::sort_heap(best.begin(), best.end());
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
+    for (const auto & candidate : best) {
+        neighbours.push_back(*candidate.second);
     }
-    return {{neighbours}, {neighbours->end()}};
+    stats.result(neighbours.size());
+    return PointView(std::move(neighbours));
+}
+
+PointView PointSet::nearest(const Point & p, std::size_t k) const
+{
+    auto stats = threadCounter();
+    return nearestWith(p, k, stats);
+}
+
+PointView PointSet::nearest(const Point & p, std::size_t k, QueryStats & stats) const
+{
+    CountInto count{stats};
+    return nearestWith(p, k, count);
 }
 
 std::ostream & operator<<(std::ostream & strm, const PointSet & points)
@@ -466,6 +903,9 @@ PointSet::PointSet(const PointSet & set)
     : max_depth(set.max_depth)
     , m_root(nullptr)
     , m_size(set.m_size)
+    , m_total_depth(set.m_total_depth)
+    , m_built_ratio(set.m_built_ratio)
+    , m_policy(set.m_policy)
 {
     copyTree(set.m_root, m_root);
 }
@@ -0,0 +1,207 @@
+#include "adaptive.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+namespace adaptive {
+
+namespace {
+
+// operations observed before the measured update rate replaces the expected one
+constexpr std::size_t min_observed_operations = 1000;
+// smallest size the doubling rule re-decides at
+constexpr std::size_t min_redecide_size = 64;
+
+double dispersion(const std::vector<Point> & points, const Profile & profile)
+{
+    if (points.size() < 2) {
+        return 1;
+    }
+    double width = profile.xmax - profile.xmin;
+    double height = profile.ymax - profile.ymin;
+    double cells = std::max(1.0, static_cast<double>(points.size()) / 4);
+    std::size_t nx = 1, ny = 1;
+    if (width > 0 && height > 0) {
+        nx = static_cast<std::size_t>(std::ceil(std::sqrt(cells * width / height)));
+        ny = static_cast<std::size_t>(std::ceil(cells / nx));
+    }
+    else if (width > 0) {
+        nx = static_cast<std::size_t>(cells);
+    }
+    else if (height > 0) {
+        ny = static_cast<std::size_t>(cells);
+    }
+    std::vector<std::size_t> counts(nx * ny, 0);
+    for (const auto & p : points) {
+        std::size_t cx = width > 0 ? std::min(nx - 1, static_cast<std::size_t>((p.x() - profile.xmin) / width * nx)) : 0;
+        std::size_t cy = height > 0 ? std::min(ny - 1, static_cast<std::size_t>((p.y() - profile.ymin) / height * ny)) : 0;
+        ++counts[cy * nx + cx];
+    }
+    double mean = static_cast<double>(points.size()) / counts.size();
+    double variance = 0;
+    for (std::size_t count : counts) {
+        variance += (count - mean) * (count - mean);
+    }
+    variance /= counts.size();
+    return variance / mean;
+}
+
+} // anonymous namespace
+
+const char * name(Backend backend)
+{
+    switch (backend) {
+    case Backend::kdtree:
+        return "kd_tree";
+    case Backend::grid:
+        return "grid";
+    case Backend::zorder:
+        return "z_order";
+    }
+    return "unknown";
+}
+
+PointSet::PointSet(const std::string & filename, const Options & options)
+    : PointSet(readPoints(filename), options)
+{
+}
+
+PointSet::PointSet(std::vector<Point> points, const Options & options)
+    : m_options(options)
+{
+    choose(std::move(points), m_options.expected_update_rate);
+}
+
+void PointSet::choose(std::vector<Point> points, double update_rate)
+{
+    std::size_t input_size = points.size();
+    points = uniquePoints(std::move(points));
+
+    Profile profile;
+    profile.count = points.size();
+    profile.duplicate_ratio = input_size == 0 ? 0 : 1 - static_cast<double>(points.size()) / input_size;
+    profile.update_rate = update_rate;
+    if (!points.empty()) {
+        auto [xmin, xmax] = std::minmax_element(points.begin(), points.end(), [](const Point & lhs, const Point & rhs) { return lhs.x() < rhs.x(); });
+        auto [ymin, ymax] = std::minmax_element(points.begin(), points.end(), [](const Point & lhs, const Point & rhs) { return lhs.y() < rhs.y(); });
+        profile.xmin = xmin->x();
+        profile.xmax = xmax->x();
+        profile.ymin = ymin->y();
+        profile.ymax = ymax->y();
+    }
+    profile.dispersion = dispersion(points, profile);
+
+    std::ostringstream reason;
+    reason << profile.count << " points, dispersion " << profile.dispersion << ", duplicates " << profile.duplicate_ratio
+           << ", update rate " << profile.update_rate << ": ";
+    Backend backend;
+    if (profile.update_rate > m_options.dynamic_threshold) {
+        backend = Backend::kdtree;
+        reason << "update rate above " << m_options.dynamic_threshold << ", the kd-tree inserts without rebuilding the index";
+    }
+    else if (profile.dispersion < m_options.uniform_dispersion) {
+        backend = Backend::grid;
+        reason << "dispersion below " << m_options.uniform_dispersion << ", the data is close to uniform and grid cells stay balanced";
+    }
+    else {
+        backend = Backend::zorder;
+        reason << "clustered static data, the sorted curve adapts to density without empty cells";
+    }
+
+    switch (backend) {
+    case Backend::kdtree:
+        m_backend.emplace<kdtree::PointSet>(std::move(points));
+        break;
+    case Backend::grid:
+        m_backend.emplace<grid::PointSet>(std::move(points));
+        break;
+    case Backend::zorder:
+        m_backend.emplace<zorder::PointSet<>>(std::move(points));
+        break;
+    }
+    m_decision = {backend, profile, reason.str()};
+}
+
+double PointSet::updateRate() const
+{
+    std::size_t operations = m_puts + m_queries.load(std::memory_order_relaxed);
+    if (operations < min_observed_operations) {
+        return m_options.expected_update_rate;
+    }
+    return static_cast<double>(m_puts) / operations;
+}
+
+void PointSet::reBuild()
+{
+    choose(std::vector<Point>(begin(), end()), updateRate());
+}
+
+const Decision & PointSet::decision() const
+{
+    return m_decision;
+}
+
+bool PointSet::empty() const
+{
+    return std::visit([](const auto & set) { return set.empty(); }, m_backend);
+}
+
+std::size_t PointSet::size() const
+{
+    return std::visit([](const auto & set) { return set.size(); }, m_backend);
+}
+
+void PointSet::put(const Point & p)
+{
+    ++m_puts;
+    std::visit([&p](auto & set) { set.put(p); }, m_backend);
+    if (size() >= 2 * std::max(m_decision.profile.count, min_redecide_size)) {
+        reBuild();
+    }
+}
+
+bool PointSet::contains(const Point & p) const
+{
+    m_queries.fetch_add(1, std::memory_order_relaxed);
+    return std::visit([&p](const auto & set) { return set.contains(p); }, m_backend);
+}
+
+PointView PointSet::range(const Rect & rect) const
+{
+    m_queries.fetch_add(1, std::memory_order_relaxed);
+    return std::visit([&rect](const auto & set) { return set.range(rect); }, m_backend);
+}
+
+PointSet::iterator PointSet::begin() const
+{
+    return std::visit([](const auto & set) { return iterator(set.begin()); }, m_backend);
+}
+
+PointSet::iterator PointSet::end() const
+{
+    return std::visit([](const auto & set) { return iterator(set.end()); }, m_backend);
+}
+
+std::optional<Point> PointSet::nearest(const Point & p) const
+{
+    m_queries.fetch_add(1, std::memory_order_relaxed);
+    return std::visit([&p](const auto & set) { return set.nearest(p); }, m_backend);
+}
+
+PointView PointSet::nearest(const Point & p, std::size_t k) const
+{
+    m_queries.fetch_add(1, std::memory_order_relaxed);
+    return std::visit([&p, k](const auto & set) { return set.nearest(p, k); }, m_backend);
+}
+
+std::ostream & operator<<(std::ostream & strm, const PointSet & points)
+{
+    for (auto it = points.begin(); it != points.end(); it++) {
+        strm << *it;
+    }
+    return strm;
+}
+
+} // namespace adaptive
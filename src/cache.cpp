@@ -0,0 +1,305 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <ranges>
+
+namespace cache {
+
+namespace {
+
+// region coordinates stay far from overflow whatever the input
+constexpr double max_cell = 1e15;
+
+std::uint64_t mix(std::uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+std::int64_t cell(double coordinate, double region_size)
+{
+    return static_cast<std::int64_t>(std::clamp(std::floor(coordinate / region_size), -max_cell, max_cell));
+}
+
+std::size_t slotOf(std::int64_t cx, std::int64_t cy, std::size_t slots)
+{
+    return mix(mix(static_cast<std::uint64_t>(cx)) ^ static_cast<std::uint64_t>(cy)) % slots;
+}
+
+// the options with region_size and shards made usable
+Options complete(Options options, const std::vector<Point> & points)
+{
+    options.shards = std::max<std::size_t>(options.shards, 1);
+    options.version_slots = std::max<std::size_t>(options.version_slots, 1);
+    if (options.region_size > 0 || points.empty()) {
+        options.region_size = options.region_size > 0 ? options.region_size : 1;
+        return options;
+    }
+    auto [xmin, xmax] = std::minmax_element(points.begin(), points.end(), [](const Point & lhs, const Point & rhs) { return lhs.x() < rhs.x(); });
+    auto [ymin, ymax] = std::minmax_element(points.begin(), points.end(), [](const Point & lhs, const Point & rhs) { return lhs.y() < rhs.y(); });
+    double side = std::max(xmax->x() - xmin->x(), ymax->y() - ymin->y()) / 64;
+    options.region_size = std::isfinite(side) && side > 0 ? side : 1;
+    return options;
+}
+
+} // anonymous namespace
+
+double Stats::hitRate() const
+{
+    return hits + misses == 0 ? 0 : static_cast<double>(hits) / (hits + misses);
+}
+
+std::size_t PointSet::KeyHash::operator()(const Key & key) const
+{
+    std::uint64_t h = mix(static_cast<std::uint64_t>(key.kind) + 1);
+    for (std::uint64_t c : key.coordinates) {
+        h = mix(h ^ c);
+    }
+    return mix(h ^ key.k);
+}
+
+PointSet::PointSet(const std::string & filename, const Options & options)
+    : PointSet(readPoints(filename), options)
+{
+}
+
+PointSet::PointSet(std::vector<Point> points, const Options & options)
+    : m_options(complete(options, points))
+    , m_tree(std::move(points))
+    , m_versions(m_options.version_slots + 1, 0)
+    , m_shards(std::make_unique<Shard[]>(m_options.shards))
+{
+}
+
+bool PointSet::empty() const
+{
+    return m_tree.empty();
+}
+
+std::size_t PointSet::size() const
+{
+    return m_tree.size();
+}
+
+void PointSet::put(const Point & p)
+{
+    std::size_t before = m_tree.size();
+    m_tree.put(p);
+    if (m_tree.size() != before) {
+        ++m_versions[slot(p.x(), p.y())];
+        ++m_versions.back();
+    }
+}
+
+bool PointSet::contains(const Point & p) const
+{
+    return m_tree.contains(p);
+}
+
+PointSet::iterator PointSet::begin() const
+{
+    return m_tree.begin();
+}
+
+PointSet::iterator PointSet::end() const
+{
+    return m_tree.end();
+}
+
+const kdtree::PointSet & PointSet::tree() const
+{
+    return m_tree;
+}
+
+std::size_t PointSet::slot(double x, double y) const
+{
+    return slotOf(cell(x, m_options.region_size), cell(y, m_options.region_size), m_options.version_slots);
+}
+
+std::vector<std::pair<std::size_t, std::uint64_t>> PointSet::versionsOf(double xmin, double ymin, double xmax, double ymax) const
+{
+    std::size_t global = m_versions.size() - 1;
+    if (!std::isfinite(xmin) || !std::isfinite(ymin) || !std::isfinite(xmax) || !std::isfinite(ymax)) {
+        return {{global, m_versions[global]}};
+    }
+    std::int64_t x0 = cell(xmin, m_options.region_size), x1 = cell(xmax, m_options.region_size);
+    std::int64_t y0 = cell(ymin, m_options.region_size), y1 = cell(ymax, m_options.region_size);
+    // compared in doubles, the product of two spans can overflow
+    if (static_cast<double>(x1 - x0 + 1) * static_cast<double>(y1 - y0 + 1) > static_cast<double>(m_options.max_regions)) {
+        return {{global, m_versions[global]}};
+    }
+    std::vector<std::size_t> slots;
+    for (std::int64_t cx = x0; cx <= x1; ++cx) {
+        for (std::int64_t cy = y0; cy <= y1; ++cy) {
+            slots.push_back(slotOf(cx, cy, global));
+        }
+    }
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    std::vector<std::pair<std::size_t, std::uint64_t>> versions;
+    versions.reserve(slots.size());
+    for (std::size_t s : slots) {
+        versions.emplace_back(s, m_versions[s]);
+    }
+    return versions;
+}
+
+std::vector<std::pair<std::size_t, std::uint64_t>> PointSet::versionsAround(const Point & p, const PointView & found, std::size_t k) const
+{
+    // with fewer than k points found, any new point is a new neighbour
+    if (found.size() < k || k == 0) {
+        std::size_t global = m_versions.size() - 1;
+        return {{global, m_versions[global]}};
+    }
+    // only a point closer than the farthest one found changes the answer; the slack covers the
+    // rounding of the distances
+    double radius = 0;
+    for (const Point & q : found) {
+        radius = std::max(radius, p.distance(q));
+    }
+    radius = radius * (1 + 1e-9) + std::numeric_limits<double>::min();
+    return versionsOf(p.x() - radius, p.y() - radius, p.x() + radius, p.y() + radius);
+}
+
+bool PointSet::current(const Entry & entry) const
+{
+    return std::all_of(entry.versions.begin(), entry.versions.end(), [this](const auto & version) { return m_versions[version.first] == version.second; });
+}
+
+PointSet::Shard & PointSet::shardOf(const Key & key) const
+{
+    return m_shards[KeyHash{}(key) % m_options.shards];
+}
+
+template <typename Compute>
+PointView PointSet::lookup(const Key & key, Compute && compute) const
+{
+    Shard & shard = shardOf(key);
+    {
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            if (current(*it->second)) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second->result;
+            }
+            shard.bytes -= it->second->bytes;
+            shard.entries.erase(it->second);
+            shard.index.erase(it);
+            m_invalidations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    // computed without the lock, so that misses on one shard do not wait for each other
+    auto [result, versions] = compute();
+    std::size_t bytes = sizeof(Entry) + 4 * sizeof(void *) + result.size() * sizeof(Point) + versions.size() * sizeof(versions[0]);
+    std::size_t capacity = m_options.capacity / m_options.shards;
+    if (bytes > capacity) {
+        return result;
+    }
+
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        // another thread stored the same query meanwhile
+        shard.bytes -= it->second->bytes;
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+    }
+    shard.entries.push_front(Entry{key, result, std::move(versions), bytes});
+    shard.index.emplace(key, shard.entries.begin());
+    shard.bytes += bytes;
+    while (shard.bytes > capacity) {
+        const Entry & last = shard.entries.back();
+        shard.bytes -= last.bytes;
+        shard.index.erase(last.key);
+        shard.entries.pop_back();
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result;
+}
+
+PointView PointSet::range(const Rect & rect) const
+{
+    double xmin = rect.xmin(), ymin = rect.ymin(), xmax = rect.xmax(), ymax = rect.ymax();
+    double quantum = m_options.quantum;
+    if (quantum > 0) {
+        xmin = std::floor(xmin / quantum) * quantum;
+        ymin = std::floor(ymin / quantum) * quantum;
+        xmax = std::ceil(xmax / quantum) * quantum;
+        ymax = std::ceil(ymax / quantum) * quantum;
+    }
+    Key key{Kind::range, {std::bit_cast<std::uint64_t>(xmin), std::bit_cast<std::uint64_t>(ymin), std::bit_cast<std::uint64_t>(xmax), std::bit_cast<std::uint64_t>(ymax)}, 0};
+    PointView cached = lookup(key, [&] {
+        return std::make_pair(m_tree.range(Rect(Point(xmin, ymin), Point(xmax, ymax))), versionsOf(xmin, ymin, xmax, ymax));
+    });
+    if (xmin == rect.xmin() && ymin == rect.ymin() && xmax == rect.xmax() && ymax == rect.ymax()) {
+        return cached;
+    }
+    std::vector<Point> points;
+    std::ranges::copy_if(cached, std::back_inserter(points), [&rect](const Point & p) { return rect.contains(p); });
+    return PointView(std::move(points));
+}
+
+std::optional<Point> PointSet::nearest(const Point & p) const
+{
+    Key key{Kind::nearest, {std::bit_cast<std::uint64_t>(p.x()), std::bit_cast<std::uint64_t>(p.y()), 0, 0}, 1};
+    PointView found = lookup(key, [&] {
+        auto nearest = m_tree.nearest(p);
+        PointView result = nearest ? PointView(std::vector<Point>{*nearest}) : PointView(std::vector<Point>{});
+        return std::make_pair(result, versionsAround(p, result, 1));
+    });
+    if (found.empty()) {
+        return std::nullopt;
+    }
+    return found.front();
+}
+
+PointView PointSet::nearest(const Point & p, std::size_t k) const
+{
+    Key key{Kind::knn, {std::bit_cast<std::uint64_t>(p.x()), std::bit_cast<std::uint64_t>(p.y()), 0, 0}, k};
+    return lookup(key, [&] {
+        PointView result = m_tree.nearest(p, k);
+        return std::make_pair(result, versionsAround(p, result, k));
+    });
+}
+
+Stats PointSet::stats() const
+{
+    Stats stats;
+    stats.hits = m_hits.load(std::memory_order_relaxed);
+    stats.misses = m_misses.load(std::memory_order_relaxed);
+    stats.invalidations = m_invalidations.load(std::memory_order_relaxed);
+    stats.evictions = m_evictions.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < m_options.shards; ++i) {
+        std::lock_guard lock(m_shards[i].mutex);
+        stats.entries += m_shards[i].entries.size();
+        stats.bytes += m_shards[i].bytes;
+    }
+    return stats;
+}
+
+void PointSet::clear()
+{
+    for (std::size_t i = 0; i < m_options.shards; ++i) {
+        std::lock_guard lock(m_shards[i].mutex);
+        m_shards[i].entries.clear();
+        m_shards[i].index.clear();
+        m_shards[i].bytes = 0;
+    }
+    m_hits = 0;
+    m_misses = 0;
+    m_invalidations = 0;
+    m_evictions = 0;
+}
+
+} // namespace cache
@@ -0,0 +1,91 @@
+#include "cluster.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace cluster {
+
+namespace {
+
+// points handed to a thread at a time by the core point pass
+constexpr std::size_t chunk = 1024;
+
+bool before(const Point & lhs, const Point & rhs)
+{
+    if (lhs.x() == rhs.x()) {
+        return lhs.y() < rhs.y();
+    }
+    return lhs.x() < rhs.x();
+}
+
+// position of a stored point; the query results are copies of them, so the search is exact
+std::size_t indexOf(const std::vector<Point> & points, const Point & p)
+{
+    return std::lower_bound(points.begin(), points.end(), p, before) - points.begin();
+}
+
+} // anonymous namespace
+
+Clustering dbscan(const kdtree::PointSet & set, double eps, std::size_t min_pts, const Options & options)
+{
+    Clustering result;
+    result.points.assign(set.begin(), set.end());
+    std::sort(result.points.begin(), result.points.end(), before);
+    const std::vector<Point> & points = result.points;
+    std::size_t n = points.size();
+    result.labels.assign(n, noise);
+
+    // bytes rather than bits, so that threads never write to the same word
+    std::vector<std::uint8_t> core(n, 0);
+    std::atomic<std::size_t> next = 0;
+    auto findCore = [&] {
+        for (std::size_t begin = next.fetch_add(chunk); begin < n; begin = next.fetch_add(chunk)) {
+            std::size_t end = std::min(begin + chunk, n);
+            for (std::size_t i = begin; i < end; ++i) {
+                core[i] = set.within(points[i], eps).size() >= min_pts;
+            }
+        }
+    };
+    std::size_t threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, (n + chunk - 1) / chunk);
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < threads; ++i) {
+        workers.emplace_back(findCore);
+    }
+    findCore();
+    for (std::thread & worker : workers) {
+        worker.join();
+    }
+    result.core_points = std::count(core.begin(), core.end(), 1);
+
+    // core points whose neighbourhood has been or is about to be expanded
+    std::vector<bool> visited(n, false);
+    std::vector<std::size_t> pending;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (!core[i] || visited[i]) {
+            continue;
+        }
+        auto id = static_cast<std::int32_t>(result.clusters++);
+        visited[i] = true;
+        result.labels[i] = id;
+        pending.push_back(i);
+        while (!pending.empty()) {
+            std::size_t current = pending.back();
+            pending.pop_back();
+            for (const Point & neighbour : set.within(points[current], eps)) {
+                std::size_t j = indexOf(points, neighbour);
+                if (result.labels[j] == noise) {
+                    result.labels[j] = id;
+                }
+                if (core[j] && !visited[j]) {
+                    visited[j] = true;
+                    pending.push_back(j);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace cluster
@@ -0,0 +1,664 @@
+#include "delaunay.h"
+
+#include "latency.h"
+#include "morton.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <unordered_set>
+
+namespace delaunay {
+
+namespace {
+
+// Geometric predicates: evaluated in double when the result is certain, exactly otherwise.
+// The error bounds and the expansion arithmetic follow Shewchuk, "Adaptive Precision
+// Floating-Point Arithmetic and Fast Robust Geometric Predicates".
+
+constexpr double epsilon = std::numeric_limits<double>::epsilon() / 2;
+constexpr double orient_bound = (3 + 16 * epsilon) * epsilon;
+constexpr double in_circle_bound = (10 + 96 * epsilon) * epsilon;
+
+// exact sum of doubles: nonoverlapping components in increasing magnitude, without zeros
+using Expansion = std::vector<double>;
+
+void add(Expansion & e, double b)
+{
+    std::size_t out = 0;
+    for (double component : e) {
+        double sum = b + component;
+        double b_virtual = sum - b;
+        double error = (b - (sum - b_virtual)) + (component - b_virtual);
+        if (error != 0) {
+            e[out++] = error;
+        }
+        b = sum;
+    }
+    e.resize(out);
+    if (b != 0) {
+        e.push_back(b);
+    }
+}
+
+void addProduct(Expansion & e, double a, double b)
+{
+    double product = a * b;
+    add(e, std::fma(a, b, -product));
+    add(e, product);
+}
+
+Expansion difference(double a, double b)
+{
+    Expansion e;
+    add(e, a);
+    add(e, -b);
+    return e;
+}
+
+Expansion product(const Expansion & lhs, const Expansion & rhs)
+{
+    Expansion e;
+    for (double a : lhs) {
+        for (double b : rhs) {
+            addProduct(e, a, b);
+        }
+    }
+    return e;
+}
+
+Expansion sum(Expansion lhs, const Expansion & rhs, double sign = 1)
+{
+    for (double b : rhs) {
+        add(lhs, sign * b);
+    }
+    return lhs;
+}
+
+int sign(const Expansion & e)
+{
+    return e.empty() ? 0 : (e.back() > 0 ? 1 : -1);
+}
+
+int sign(double value)
+{
+    return (value > 0) - (value < 0);
+}
+
+// positive when a, b, c turn counterclockwise, zero when they are collinear
+int orient(const Point & a, const Point & b, const Point & c)
+{
+    double left = (a.x() - c.x()) * (b.y() - c.y());
+    double right = (a.y() - c.y()) * (b.x() - c.x());
+    double det = left - right;
+    if (std::abs(det) > orient_bound * (std::abs(left) + std::abs(right))) {
+        return sign(det);
+    }
+    Expansion e;
+    addProduct(e, a.x(), b.y());
+    addProduct(e, -a.x(), c.y());
+    addProduct(e, -c.x(), b.y());
+    addProduct(e, -a.y(), b.x());
+    addProduct(e, a.y(), c.x());
+    addProduct(e, c.y(), b.x());
+    return sign(e);
+}
+
+// positive when d lies inside the circle through the counterclockwise triangle a, b, c
+int inCircle(const Point & a, const Point & b, const Point & c, const Point & d)
+{
+    double adx = a.x() - d.x(), ady = a.y() - d.y();
+    double bdx = b.x() - d.x(), bdy = b.y() - d.y();
+    double cdx = c.x() - d.x(), cdy = c.y() - d.y();
+    double bc = bdx * cdy, cb = cdx * bdy;
+    double ca = cdx * ady, ac = adx * cdy;
+    double ab = adx * bdy, ba = bdx * ady;
+    double alift = adx * adx + ady * ady;
+    double blift = bdx * bdx + bdy * bdy;
+    double clift = cdx * cdx + cdy * cdy;
+    double det = alift * (bc - cb) + blift * (ca - ac) + clift * (ab - ba);
+    double permanent = (std::abs(bc) + std::abs(cb)) * alift + (std::abs(ca) + std::abs(ac)) * blift + (std::abs(ab) + std::abs(ba)) * clift;
+    if (std::abs(det) > in_circle_bound * permanent) {
+        return sign(det);
+    }
+    Expansion ex = difference(a.x(), d.x()), ey = difference(a.y(), d.y());
+    Expansion fx = difference(b.x(), d.x()), fy = difference(b.y(), d.y());
+    Expansion gx = difference(c.x(), d.x()), gy = difference(c.y(), d.y());
+    auto lift = [](const Expansion & x, const Expansion & y) { return sum(product(x, x), product(y, y)); };
+    auto cross = [](const Expansion & x1, const Expansion & y1, const Expansion & x2, const Expansion & y2) {
+        return sum(product(x1, y2), product(y1, x2), -1);
+    };
+    Expansion e = product(lift(ex, ey), cross(fx, fy, gx, gy));
+    e = sum(std::move(e), product(lift(fx, fy), cross(gx, gy, ex, ey)));
+    e = sum(std::move(e), product(lift(gx, gy), cross(ex, ey, fx, fy)));
+    return sign(e);
+}
+
+// Incremental Delaunay triangulation (Bowyer-Watson). The convex hull is closed by ghost
+// triangles that share one vertex at infinity, so points outside the hull are inserted the
+// same way as points inside it. Triangles are counterclockwise and neighbour i lies across
+// the edge opposite vertex i.
+class Triangulation
+{
+public:
+    static constexpr std::size_t ghost = std::numeric_limits<std::size_t>::max();
+
+    // `order` starts with three points that are not collinear
+    Triangulation(const std::vector<Point> & points, const std::vector<std::size_t> & order)
+        : m_points(points)
+    {
+        auto a = order[0], b = order[1], c = order[2];
+        if (orient(m_points[a], m_points[b], m_points[c]) < 0) {
+            std::swap(b, c);
+        }
+        m_triangles = {{{a, b, c}, {}}, {{c, b, ghost}, {}}, {{a, c, ghost}, {}}, {{b, a, ghost}, {}}};
+        for (auto & t : m_triangles) {
+            for (std::size_t i = 0; i < 3; ++i) {
+                for (std::size_t u = 0; u < m_triangles.size(); ++u) {
+                    if (opposite(u, t.v[(i + 2) % 3], t.v[(i + 1) % 3]) < 3) {
+                        t.n[i] = u;
+                    }
+                }
+            }
+        }
+        m_stamp.assign(m_triangles.size(), 0);
+        m_conflict.assign(m_triangles.size(), false);
+        for (std::size_t i = 3; i < order.size(); ++i) {
+            insert(order[i], i);
+        }
+    }
+
+    // calls visit(a, b) once for every directed edge between two points
+    template <typename Visit>
+    void edges(Visit && visit) const
+    {
+        for (const auto & t : m_triangles) {
+            for (std::size_t i = 0; i < 3; ++i) {
+                if (t.v[i] != ghost && t.v[(i + 1) % 3] != ghost) {
+                    visit(t.v[i], t.v[(i + 1) % 3]);
+                }
+            }
+        }
+    }
+
+private:
+    struct Triangle
+    {
+        std::array<std::size_t, 3> v;
+        std::array<std::size_t, 3> n;
+    };
+
+    // boundary edge a -> b of a cavity and the triangle outside it
+    struct Edge
+    {
+        std::size_t a;
+        std::size_t b;
+        std::size_t outside;
+    };
+
+    const std::vector<Point> & m_points;
+    std::vector<Triangle> m_triangles;
+    // insertion that last tested the triangle for conflict, and the outcome
+    std::vector<std::size_t> m_stamp;
+    std::vector<bool> m_conflict;
+    std::size_t m_last = 0;
+    std::vector<std::size_t> m_cavity;
+    std::vector<Edge> m_boundary;
+    std::vector<std::pair<std::size_t, std::size_t>> m_created;
+
+    // index of the vertex of triangle t opposite the edge a -> b, 3 when t has no such edge
+    std::size_t opposite(std::size_t t, std::size_t a, std::size_t b) const
+    {
+        const auto & v = m_triangles[t].v;
+        for (std::size_t i = 0; i < 3; ++i) {
+            if (v[(i + 1) % 3] == a && v[(i + 2) % 3] == b) {
+                return i;
+            }
+        }
+        return 3;
+    }
+
+    std::size_t ghostIndex(std::size_t t) const
+    {
+        const auto & v = m_triangles[t].v;
+        return v[0] == ghost ? 0 : (v[1] == ghost ? 1 : (v[2] == ghost ? 2 : 3));
+    }
+
+    // whether p lies inside the circumcircle of t; for a ghost triangle that is the open half
+    // plane beyond its hull edge together with the inside of the edge itself
+    bool inConflict(std::size_t t, const Point & p) const
+    {
+        const auto & v = m_triangles[t].v;
+        std::size_t g = ghostIndex(t);
+        if (g == 3) {
+            return inCircle(m_points[v[0]], m_points[v[1]], m_points[v[2]], p) > 0;
+        }
+        const Point & a = m_points[v[(g + 1) % 3]];
+        const Point & b = m_points[v[(g + 2) % 3]];
+        int side = orient(a, b, p);
+        if (side != 0) {
+            return side > 0;
+        }
+        if (a.x() != b.x()) {
+            return std::min(a.x(), b.x()) < p.x() && p.x() < std::max(a.x(), b.x());
+        }
+        return std::min(a.y(), b.y()) < p.y() && p.y() < std::max(a.y(), b.y());
+    }
+
+    // visibility walk from the last created triangle to one that contains p or to the ghost
+    // triangle whose hull edge p lies beyond
+    std::size_t locate(const Point & p) const
+    {
+        std::size_t t = m_last;
+        for (std::size_t step = 0;; ++step) {
+            const auto & tri = m_triangles[t];
+            std::size_t next = t;
+            for (std::size_t k = 0; k < 3 && next == t; ++k) {
+                std::size_t i = (k + step) % 3;
+                if (orient(m_points[tri.v[(i + 1) % 3]], m_points[tri.v[(i + 2) % 3]], p) < 0) {
+                    next = tri.n[i];
+                }
+            }
+            if (next == t) {
+                return t;
+            }
+            t = next;
+            if (ghostIndex(t) != 3) {
+                return t;
+            }
+        }
+    }
+
+    void insert(std::size_t index, std::size_t stamp)
+    {
+        const Point & p = m_points[index];
+        std::size_t start = locate(p);
+        m_cavity.assign(1, start);
+        m_stamp[start] = stamp;
+        m_conflict[start] = true;
+        m_boundary.clear();
+        for (std::size_t k = 0; k < m_cavity.size(); ++k) {
+            const auto & t = m_triangles[m_cavity[k]];
+            for (std::size_t i = 0; i < 3; ++i) {
+                std::size_t u = t.n[i];
+                if (m_stamp[u] != stamp) {
+                    m_stamp[u] = stamp;
+                    m_conflict[u] = inConflict(u, p);
+                    if (m_conflict[u]) {
+                        m_cavity.push_back(u);
+                    }
+                }
+                if (!m_conflict[u]) {
+                    m_boundary.push_back({t.v[(i + 1) % 3], t.v[(i + 2) % 3], u});
+                }
+            }
+        }
+        // the cavity is star-shaped from p: connect p to every boundary edge, reusing the slots
+        // of the removed triangles (there are always two fewer of them)
+        m_created.clear();
+        for (std::size_t k = 0; k < m_boundary.size(); ++k) {
+            const Edge & edge = m_boundary[k];
+            std::size_t t = k;
+            if (k < m_cavity.size()) {
+                t = m_cavity[k];
+            }
+            else {
+                t = m_triangles.size();
+                m_triangles.emplace_back();
+                m_stamp.push_back(0);
+                m_conflict.push_back(false);
+            }
+            m_triangles[t] = {{index, edge.a, edge.b}, {edge.outside, ghost, ghost}};
+            m_triangles[edge.outside].n[opposite(edge.outside, edge.b, edge.a)] = t;
+            m_created.emplace_back(edge.a, t);
+            if (edge.a != ghost && edge.b != ghost) {
+                m_last = t;
+            }
+        }
+        for (const auto & [a, t] : m_created) {
+            std::size_t b = m_triangles[t].v[2];
+            auto next = std::find_if(m_created.begin(), m_created.end(), [b](const auto & created) { return created.first == b; });
+            m_triangles[t].n[1] = next->second;
+            m_triangles[next->second].n[2] = t;
+        }
+    }
+};
+
+} // anonymous namespace
+
+PointSet::PointSet(const std::string & filename)
+    : PointSet(readPoints(filename))
+{
+}
+
+PointSet::PointSet(std::vector<Point> points)
+    : m_points(uniquePoints(std::move(points)))
+{
+    reBuild();
+}
+
+void PointSet::reBuild()
+{
+    latency::Timer timer(latency::Operation::rebuild);
+    m_indexed = m_points.size();
+    buildCells();
+    buildGraph();
+}
+
+void PointSet::buildCells()
+{
+    m_start.clear();
+    if (m_points.empty()) {
+        m_nx = m_ny = 0;
+        m_cell_offsets.assign(1, 0);
+        return;
+    }
+    auto [xmin, xmax] = std::minmax_element(m_points.begin(), m_points.end(), [](const Point & lhs, const Point & rhs) { return lhs.x() < rhs.x(); });
+    auto [ymin, ymax] = std::minmax_element(m_points.begin(), m_points.end(), [](const Point & lhs, const Point & rhs) { return lhs.y() < rhs.y(); });
+    m_xmin = xmin->x();
+    m_ymin = ymin->y();
+    double width = xmax->x() - m_xmin;
+    double height = ymax->y() - m_ymin;
+    double cells = std::max(1.0, static_cast<double>(m_points.size()) / points_per_cell);
+    // the second bound keeps the grid from degenerating on (almost) collinear data
+    m_cell = std::max(std::sqrt(width * height / cells), std::max(width, height) / cells);
+    if (!(m_cell > 0)) {
+        m_cell = 1;
+    }
+    m_nx = static_cast<std::size_t>(width / m_cell) + 1;
+    m_ny = static_cast<std::size_t>(height / m_cell) + 1;
+
+    std::vector<std::size_t> cell_of(m_points.size());
+    m_cell_offsets.assign(m_nx * m_ny + 1, 0);
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        cell_of[i] = cellY(m_points[i].y()) * m_nx + cellX(m_points[i].x());
+        ++m_cell_offsets[cell_of[i] + 1];
+    }
+    for (std::size_t c = 1; c < m_cell_offsets.size(); ++c) {
+        m_cell_offsets[c] += m_cell_offsets[c - 1];
+    }
+    std::vector<std::size_t> fill(m_cell_offsets.begin(), m_cell_offsets.end() - 1);
+    std::vector<Point> sorted(m_points.size(), Point(0, 0));
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        sorted[fill[cell_of[i]]++] = m_points[i];
+    }
+    m_points = std::move(sorted);
+
+    // a cell's walks start at its point closest to the cell centre; empty cells borrow the
+    // start of the nearest non-empty cell in grid steps
+    constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+    m_start.assign(m_nx * m_ny, none);
+    std::queue<std::size_t> queue;
+    for (std::size_t c = 0; c < m_start.size(); ++c) {
+        Point centre(m_xmin + (c % m_nx + 0.5) * m_cell, m_ymin + (c / m_nx + 0.5) * m_cell);
+        double best = std::numeric_limits<double>::infinity();
+        for (std::size_t i = m_cell_offsets[c]; i < m_cell_offsets[c + 1]; ++i) {
+            double dist = squaredDistance(m_points[i], centre);
+            if (dist < best) {
+                best = dist;
+                m_start[c] = i;
+            }
+        }
+        if (m_start[c] != none) {
+            queue.push(c);
+        }
+    }
+    for (; !queue.empty(); queue.pop()) {
+        std::size_t c = queue.front();
+        std::size_t cx = c % m_nx, cy = c / m_nx;
+        auto spread = [&](std::size_t to) {
+            if (m_start[to] == none) {
+                m_start[to] = m_start[c];
+                queue.push(to);
+            }
+        };
+        if (cx > 0) {
+            spread(c - 1);
+        }
+        if (cx + 1 < m_nx) {
+            spread(c + 1);
+        }
+        if (cy > 0) {
+            spread(c - m_nx);
+        }
+        if (cy + 1 < m_ny) {
+            spread(c + m_nx);
+        }
+    }
+}
+
+void PointSet::buildGraph()
+{
+    std::size_t n = m_indexed;
+    m_offsets.assign(n + 1, 0);
+    m_adjacent.clear();
+    // lexicographic order puts collinear points in order along their line
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs) {
+        const Point & a = m_points[lhs];
+        const Point & b = m_points[rhs];
+        return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+    });
+    std::size_t third = 2;
+    while (third < n && orient(m_points[order[0]], m_points[order[1]], m_points[order[third]]) == 0) {
+        ++third;
+    }
+    if (third >= n) {
+        // the Delaunay graph of collinear points is the path through them
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+            ++m_offsets[order[i] + 1];
+            ++m_offsets[order[i + 1] + 1];
+        }
+        auto edges = [&order, n](auto && visit) {
+            for (std::size_t i = 0; i + 1 < n; ++i) {
+                visit(order[i], order[i + 1]);
+                visit(order[i + 1], order[i]);
+            }
+        };
+        link(edges);
+        return;
+    }
+
+    // inserting in Morton order keeps every point close to the previous one, so the walk
+    // that locates it is short
+    double xscale = 65535 / std::max(m_cell, static_cast<double>(m_nx) * m_cell);
+    double yscale = 65535 / std::max(m_cell, static_cast<double>(m_ny) * m_cell);
+    std::vector<std::uint64_t> codes(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        codes[i] = morton::encode(static_cast<std::uint32_t>((m_points[i].x() - m_xmin) * xscale),
+                                  static_cast<std::uint32_t>((m_points[i].y() - m_ymin) * yscale));
+    }
+    std::swap(order[2], order[third]);
+    std::sort(order.begin() + 3, order.end(), [&codes](std::size_t lhs, std::size_t rhs) { return codes[lhs] < codes[rhs]; });
+
+    Triangulation triangulation(m_points, order);
+    triangulation.edges([this](std::size_t a, std::size_t) { ++m_offsets[a + 1]; });
+    link([&triangulation](auto && visit) { triangulation.edges(visit); });
+}
+
+template <typename Edges>
+void PointSet::link(Edges && edges)
+{
+    for (std::size_t i = 0; i < m_indexed; ++i) {
+        m_offsets[i + 1] += m_offsets[i];
+    }
+    m_adjacent.resize(m_offsets[m_indexed]);
+    std::vector<std::size_t> fill(m_offsets.begin(), m_offsets.end() - 1);
+    edges([&](std::size_t a, std::size_t b) { m_adjacent[fill[a]++] = b; });
+}
+
+std::size_t PointSet::cellX(double x) const
+{
+    if (x <= m_xmin) {
+        return 0;
+    }
+    return std::min(static_cast<std::size_t>((x - m_xmin) / m_cell), m_nx - 1);
+}
+
+std::size_t PointSet::cellY(double y) const
+{
+    if (y <= m_ymin) {
+        return 0;
+    }
+    return std::min(static_cast<std::size_t>((y - m_ymin) / m_cell), m_ny - 1);
+}
+
+std::size_t PointSet::walk(const Point & p) const
+{
+    std::size_t current = m_start[cellY(p.y()) * m_nx + cellX(p.x())];
+    double best = squaredDistance(m_points[current], p);
+    for (std::size_t previous = m_indexed; previous != current;) {
+        previous = current;
+        for (std::size_t i = m_offsets[previous]; i < m_offsets[previous + 1]; ++i) {
+            double dist = squaredDistance(m_points[m_adjacent[i]], p);
+            if (dist < best) {
+                best = dist;
+                current = m_adjacent[i];
+            }
+        }
+    }
+    return current;
+}
+
+bool PointSet::empty() const
+{
+    return m_points.empty();
+}
+
+std::size_t PointSet::size() const
+{
+    return m_points.size();
+}
+
+void PointSet::put(const Point & p)
+{
+    if (contains(p)) {
+        return;
+    }
+    m_points.push_back(p);
+    // points outside the indexed part are scanned linearly, so keep that tail short
+    if (m_points.size() - m_indexed > std::max<std::size_t>(16, m_indexed / 8)) {
+        reBuild();
+    }
+}
+
+bool PointSet::contains(const Point & p) const
+{
+    if (m_indexed > 0) {
+        std::size_t c = cellY(p.y()) * m_nx + cellX(p.x());
+        auto first = m_points.begin() + m_cell_offsets[c];
+        auto last = m_points.begin() + m_cell_offsets[c + 1];
+        if (std::find(first, last, p) != last) {
+            return true;
+        }
+    }
+    return std::find(m_points.begin() + m_indexed, m_points.end(), p) != m_points.end();
+}
+
+PointView PointSet::range(const Rect & rect) const
+{
+    std::vector<Point> in_rect;
+    auto collect = [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+            if (rect.contains(m_points[i])) {
+                in_rect.push_back(m_points[i]);
+            }
+        }
+    };
+    if (m_indexed > 0) {
+        std::size_t x_first = cellX(rect.xmin()), x_last = cellX(rect.xmax());
+        std::size_t y_first = cellY(rect.ymin()), y_last = cellY(rect.ymax());
+        for (std::size_t cy = y_first; cy <= y_last; ++cy) {
+            collect(m_cell_offsets[cy * m_nx + x_first], m_cell_offsets[cy * m_nx + x_last + 1]);
+        }
+    }
+    collect(m_indexed, m_points.size());
+    return PointView(std::move(in_rect));
+}
+
+PointSet::iterator PointSet::begin() const
+{
+    return m_points.begin();
+}
+
+PointSet::iterator PointSet::end() const
+{
+    return m_points.end();
+}
+
+std::optional<Point> PointSet::nearest(const Point & point) const
+{
+    if (empty()) {
+        return std::nullopt;
+    }
+    const Point * closest = nullptr;
+    double best = std::numeric_limits<double>::infinity();
+    if (m_indexed > 0) {
+        closest = &m_points[walk(point)];
+        best = squaredDistance(*closest, point);
+    }
+    for (std::size_t i = m_indexed; i < m_points.size(); ++i) {
+        double dist = squaredDistance(m_points[i], point);
+        if (dist < best) {
+            best = dist;
+            closest = &m_points[i];
+        }
+    }
+    return *closest;
+}
+
+PointView PointSet::nearest(const Point & point, std::size_t k) const
+{
+    if (k >= size()) {
+        return PointView(std::vector<Point>(begin(), end()));
+    }
+    if (k == 0) {
+        return {};
+    }
+    std::vector<std::pair<double, std::size_t>> found;
+    found.reserve(k + m_points.size() - m_indexed);
+    if (m_indexed > 0) {
+        // best-first expansion from the nearest point: every popped point is the next nearest
+        using Candidate = std::pair<double, std::size_t>;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<>> frontier;
+        std::unordered_set<std::size_t> seen;
+        std::size_t start = walk(point);
+        frontier.emplace(squaredDistance(m_points[start], point), start);
+        seen.insert(start);
+        while (found.size() < k && !frontier.empty()) {
+            auto [dist, i] = frontier.top();
+            frontier.pop();
+            found.emplace_back(dist, i);
+            for (std::size_t j = m_offsets[i]; j < m_offsets[i + 1]; ++j) {
+                if (seen.insert(m_adjacent[j]).second) {
+                    frontier.emplace(squaredDistance(m_points[m_adjacent[j]], point), m_adjacent[j]);
+                }
+            }
+        }
+    }
+    for (std::size_t i = m_indexed; i < m_points.size(); ++i) {
+        found.emplace_back(squaredDistance(m_points[i], point), i);
+    }
+    std::partial_sort(found.begin(), found.begin() + k, found.end());
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
+    for (std::size_t i = 0; i < k; ++i) {
+        neighbours.push_back(m_points[found[i].second]);
+    }
+    return PointView(std::move(neighbours));
+}
+
+std::ostream & operator<<(std::ostream & strm, const PointSet & points)
+{
+    for (auto it = points.begin(); it != points.end(); it++) {
+        strm << *it;
+    }
+    return strm;
+}
+
+} // namespace delaunay
@@ -0,0 +1,272 @@
+#include "grid.h"
+
+#include "latency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <queue>
+
+namespace grid {
+
+PointSet::PointSet(const std::string & filename)
+    : PointSet(readPoints(filename))
+{
+}
+
+PointSet::PointSet(std::vector<Point> points)
+    : m_points(uniquePoints(std::move(points)))
+{
+    reBuild();
+}
+
+void PointSet::reBuild()
+{
+    latency::Timer timer(latency::Operation::rebuild);
+    m_indexed = m_points.size();
+    if (m_points.empty()) {
+        m_nx = m_ny = 0;
+        m_offsets.assign(1, 0);
+        return;
+    }
+    auto [xmin, xmax] = std::minmax_element(m_points.begin(), m_points.end(), [](const Point & lhs, const Point & rhs) { return lhs.x() < rhs.x(); });
+    auto [ymin, ymax] = std::minmax_element(m_points.begin(), m_points.end(), [](const Point & lhs, const Point & rhs) { return lhs.y() < rhs.y(); });
+    m_xmin = xmin->x();
+    m_ymin = ymin->y();
+    double width = xmax->x() - m_xmin;
+    double height = ymax->y() - m_ymin;
+    double cells = std::max(1.0, static_cast<double>(m_points.size()) / points_per_cell);
+    // the second bound keeps the grid from degenerating on (almost) collinear data
+    m_cell = std::max(std::sqrt(width * height / cells), std::max(width, height) / cells);
+    if (!(m_cell > 0)) {
+        m_cell = 1;
+    }
+    m_nx = static_cast<std::size_t>(width / m_cell) + 1;
+    m_ny = static_cast<std::size_t>(height / m_cell) + 1;
+
+    std::vector<std::size_t> cell_of(m_points.size());
+    m_offsets.assign(m_nx * m_ny + 1, 0);
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        cell_of[i] = cellY(m_points[i].y()) * m_nx + cellX(m_points[i].x());
+        ++m_offsets[cell_of[i] + 1];
+    }
+    for (std::size_t c = 1; c < m_offsets.size(); ++c) {
+        m_offsets[c] += m_offsets[c - 1];
+    }
+    std::vector<std::size_t> fill(m_offsets.begin(), m_offsets.end() - 1);
+    std::vector<Point> sorted(m_points.size(), Point(0, 0));
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        sorted[fill[cell_of[i]]++] = m_points[i];
+    }
+    m_points = std::move(sorted);
+}
+
+std::size_t PointSet::cellX(double x) const
+{
+    if (x <= m_xmin) {
+        return 0;
+    }
+    return std::min(static_cast<std::size_t>((x - m_xmin) / m_cell), m_nx - 1);
+}
+
+std::size_t PointSet::cellY(double y) const
+{
+    if (y <= m_ymin) {
+        return 0;
+    }
+    return std::min(static_cast<std::size_t>((y - m_ymin) / m_cell), m_ny - 1);
+}
+
+bool PointSet::empty() const
+{
+    return m_points.empty();
+}
+
+std::size_t PointSet::size() const
+{
+    return m_points.size();
+}
+
+void PointSet::put(const Point & p)
+{
+    if (contains(p)) {
+        return;
+    }
+    m_points.push_back(p);
+    // points outside the indexed part are scanned linearly, so keep that tail short
+    if (m_points.size() - m_indexed > std::max<std::size_t>(16, m_indexed / 8)) {
+        reBuild();
+    }
+}
+
+bool PointSet::contains(const Point & p) const
+{
+    if (m_indexed > 0) {
+        std::size_t c = cellY(p.y()) * m_nx + cellX(p.x());
+        auto first = m_points.begin() + m_offsets[c];
+        auto last = m_points.begin() + m_offsets[c + 1];
+        if (std::find(first, last, p) != last) {
+            return true;
+        }
+    }
+    return std::find(m_points.begin() + m_indexed, m_points.end(), p) != m_points.end();
+}
+
+PointView PointSet::range(const Rect & rect) const
+{
+    std::vector<Point> in_rect;
+    auto collect = [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+            if (rect.contains(m_points[i])) {
+                in_rect.push_back(m_points[i]);
+            }
+        }
+    };
+    if (m_indexed > 0) {
+        std::size_t x_first = cellX(rect.xmin()), x_last = cellX(rect.xmax());
+        std::size_t y_first = cellY(rect.ymin()), y_last = cellY(rect.ymax());
+        for (std::size_t cy = y_first; cy <= y_last; ++cy) {
+            // cells of one row are adjacent in the CSR array
+            collect(m_offsets[cy * m_nx + x_first], m_offsets[cy * m_nx + x_last + 1]);
+        }
+    }
+    collect(m_indexed, m_points.size());
+    return PointView(std::move(in_rect));
+}
+
+PointSet::iterator PointSet::begin() const
+{
+    return m_points.begin();
+}
+
+PointSet::iterator PointSet::end() const
+{
+    return m_points.end();
+}
+
+double PointSet::ringBound(const Point & p, std::size_t cx, std::size_t cy, std::size_t r) const
+{
+    auto gap = [](double v, double lo, double hi) { return std::max({0.0, lo - v, v - hi}); };
+    double gx = gap(p.x(), m_xmin, m_xmin + m_nx * m_cell);
+    double gy = gap(p.y(), m_ymin, m_ymin + m_ny * m_cell);
+    double bound = std::numeric_limits<double>::infinity();
+    auto side = [&](double along, double across) { bound = std::min(bound, along * along + across * across); };
+    if (cx + r < m_nx) {
+        side(std::max(0.0, m_xmin + (cx + r) * m_cell - p.x()), gy);
+    }
+    if (cx >= r) {
+        side(std::max(0.0, p.x() - (m_xmin + (cx - r + 1) * m_cell)), gy);
+    }
+    if (cy + r < m_ny) {
+        side(std::max(0.0, m_ymin + (cy + r) * m_cell - p.y()), gx);
+    }
+    if (cy >= r) {
+        side(std::max(0.0, p.y() - (m_ymin + (cy - r + 1) * m_cell)), gx);
+    }
+    return bound;
+}
+
+template <typename Visit>
+void PointSet::visitRing(std::size_t cx, std::size_t cy, std::size_t r, Visit && visit) const
+{
+    if (r == 0) {
+        std::size_t c = cy * m_nx + cx;
+        visit(m_offsets[c], m_offsets[c + 1]);
+        return;
+    }
+    std::size_t x_first = cx >= r ? cx - r : 0;
+    std::size_t x_last = std::min(cx + r, m_nx - 1);
+    auto row = [&](std::size_t y) { visit(m_offsets[y * m_nx + x_first], m_offsets[y * m_nx + x_last + 1]); };
+    if (cy >= r) {
+        row(cy - r);
+    }
+    if (cy + r < m_ny) {
+        row(cy + r);
+    }
+    std::size_t y_last = std::min(cy + r - 1, m_ny - 1);
+    for (std::size_t y = cy >= r ? cy - r + 1 : 0; y <= y_last; ++y) {
+        if (cx >= r) {
+            std::size_t c = y * m_nx + cx - r;
+            visit(m_offsets[c], m_offsets[c + 1]);
+        }
+        if (cx + r < m_nx) {
+            std::size_t c = y * m_nx + cx + r;
+            visit(m_offsets[c], m_offsets[c + 1]);
+        }
+    }
+}
+
+std::optional<Point> PointSet::nearest(const Point & point) const
+{
+    if (empty()) {
+        return std::nullopt;
+    }
+    const Point * closest = nullptr;
+    double best = std::numeric_limits<double>::infinity();
+    auto scan = [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+            double dist = squaredDistance(m_points[i], point);
+            if (dist < best) {
+                best = dist;
+                closest = &m_points[i];
+            }
+        }
+    };
+    scan(m_indexed, m_points.size());
+    if (m_indexed > 0) {
+        std::size_t cx = cellX(point.x()), cy = cellY(point.y());
+        for (std::size_t r = 0; r == 0 || ringBound(point, cx, cy, r) < best; ++r) {
+            visitRing(cx, cy, r, scan);
+        }
+    }
+    return *closest;
+}
+
+PointView PointSet::nearest(const Point & point, std::size_t k) const
+{
+    if (k >= size()) {
+        return PointView(std::vector<Point>(begin(), end()));
+    }
+    if (k == 0) {
+        return {};
+    }
+    // max-heap on distance holding the best k candidates seen so far
+    std::priority_queue<std::pair<double, std::size_t>> heap;
+    auto scan = [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+            double dist = squaredDistance(m_points[i], point);
+            if (heap.size() < k) {
+                heap.emplace(dist, i);
+            }
+            else if (dist < heap.top().first) {
+                heap.pop();
+                heap.emplace(dist, i);
+            }
+        }
+    };
+    auto kth = [&] { return heap.size() < k ? std::numeric_limits<double>::infinity() : heap.top().first; };
+    scan(m_indexed, m_points.size());
+    if (m_indexed > 0) {
+        std::size_t cx = cellX(point.x()), cy = cellY(point.y());
+        for (std::size_t r = 0; r == 0 || ringBound(point, cx, cy, r) < kth(); ++r) {
+            visitRing(cx, cy, r, scan);
+        }
+    }
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
+    for (; !heap.empty(); heap.pop()) {
+        neighbours.push_back(m_points[heap.top().second]);
+    }
+    return PointView(std::move(neighbours));
+}
+
+std::ostream & operator<<(std::ostream & strm, const PointSet & points)
+{
+    for (auto it = points.begin(); it != points.end(); it++) {
+        strm << *it;
+    }
+    return strm;
+}
+
+} // namespace grid
@@ -0,0 +1,116 @@
+#include "kernels.h"
+
+#include <cmath>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the vector loads read a run of points as interleaved x, y doubles
+static_assert(std::is_standard_layout_v<Point> && sizeof(Point) == 2 * sizeof(double));
+
+namespace kernels {
+
+namespace {
+
+const double * coordinates(const Point * points)
+{
+    return reinterpret_cast<const double *>(points);
+}
+
+bool containsOne(const Rect & rect, const Point & p)
+{
+    return p.x() >= rect.xmin() && p.x() <= rect.xmax() && p.y() >= rect.ymin() && p.y() <= rect.ymax();
+}
+
+double distanceOne(const Point & p, const Point & q)
+{
+    double dx = p.x() - q.x();
+    double dy = p.y() - q.y();
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+} // anonymous namespace
+
+std::size_t contains(const Rect & rect, const Point * points, std::size_t count, bool * out)
+{
+    std::size_t i = 0, found = 0;
+#if defined(__AVX2__)
+    // two points per vector, as x0 y0 x1 y1
+    const __m256d low = _mm256_setr_pd(rect.xmin(), rect.ymin(), rect.xmin(), rect.ymin());
+    const __m256d high = _mm256_setr_pd(rect.xmax(), rect.ymax(), rect.xmax(), rect.ymax());
+    for (; i + 4 <= count; i += 4) {
+        __m256d first = _mm256_loadu_pd(coordinates(points + i));
+        __m256d second = _mm256_loadu_pd(coordinates(points + i + 2));
+        __m256d in_first = _mm256_and_pd(_mm256_cmp_pd(first, low, _CMP_GE_OQ), _mm256_cmp_pd(first, high, _CMP_LE_OQ));
+        __m256d in_second = _mm256_and_pd(_mm256_cmp_pd(second, low, _CMP_GE_OQ), _mm256_cmp_pd(second, high, _CMP_LE_OQ));
+        // bit 2j and 2j + 1 are the x and y test of point j
+        int mask = _mm256_movemask_pd(in_first) | (_mm256_movemask_pd(in_second) << 4);
+        for (int j = 0; j < 4; ++j) {
+            bool inside = ((mask >> (2 * j)) & 3) == 3;
+            out[i + j] = inside;
+            found += inside;
+        }
+    }
+#elif defined(__SSE2__)
+    // one point per vector
+    const __m128d low = _mm_setr_pd(rect.xmin(), rect.ymin());
+    const __m128d high = _mm_setr_pd(rect.xmax(), rect.ymax());
+    for (; i < count; ++i) {
+        __m128d p = _mm_loadu_pd(coordinates(points + i));
+        bool inside = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(p, low), _mm_cmple_pd(p, high))) == 3;
+        out[i] = inside;
+        found += inside;
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = containsOne(rect, points[i]);
+        found += out[i];
+    }
+    return found;
+}
+
+void distances(const Point & p, const Point * points, std::size_t count, double * out)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    const __m256d origin = _mm256_setr_pd(p.x(), p.y(), p.x(), p.y());
+    for (; i + 4 <= count; i += 4) {
+        __m256d first = _mm256_sub_pd(_mm256_loadu_pd(coordinates(points + i)), origin);
+        __m256d second = _mm256_sub_pd(_mm256_loadu_pd(coordinates(points + i + 2)), origin);
+        // squared lengths of points i, i + 2, i + 1, i + 3
+        __m256d sums = _mm256_hadd_pd(_mm256_mul_pd(first, first), _mm256_mul_pd(second, second));
+        sums = _mm256_permute4x64_pd(sums, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_pd(out + i, _mm256_sqrt_pd(sums));
+    }
+#elif defined(__SSE2__)
+    const __m128d origin = _mm_setr_pd(p.x(), p.y());
+    for (; i + 2 <= count; i += 2) {
+        __m128d first = _mm_sub_pd(_mm_loadu_pd(coordinates(points + i)), origin);
+        __m128d second = _mm_sub_pd(_mm_loadu_pd(coordinates(points + i + 1)), origin);
+        first = _mm_mul_pd(first, first);
+        second = _mm_mul_pd(second, second);
+        __m128d sums = _mm_add_pd(_mm_unpacklo_pd(first, second), _mm_unpackhi_pd(first, second));
+        _mm_storeu_pd(out + i, _mm_sqrt_pd(sums));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = distanceOne(points[i], p);
+    }
+}
+
+const char * instructionSet()
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace kernels
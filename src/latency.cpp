@@ -0,0 +1,270 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace latency {
+
+namespace {
+
+constexpr std::uint64_t no_min = std::numeric_limits<std::uint64_t>::max();
+
+// buckets of one operation; only the owning thread writes them, so plain loads and stores
+// suffice and the atomics are there for the readers
+struct Histogram
+{
+    std::array<std::atomic<std::uint64_t>, Snapshot::bucket_count> buckets{};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> min{no_min};
+    std::atomic<std::uint64_t> max{0};
+
+    static void add(std::atomic<std::uint64_t> & counter, std::uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void record(std::uint64_t nanoseconds)
+    {
+        add(buckets[Snapshot::bucketOf(nanoseconds)], 1);
+        add(sum, nanoseconds);
+        if (nanoseconds < min.load(std::memory_order_relaxed)) {
+            min.store(nanoseconds, std::memory_order_relaxed);
+        }
+        if (nanoseconds > max.load(std::memory_order_relaxed)) {
+            max.store(nanoseconds, std::memory_order_relaxed);
+        }
+    }
+
+    // the caller holds the registry lock, which makes it the only writer of `this`
+    void merge(const Histogram & other)
+    {
+        for (std::size_t i = 0; i < buckets.size(); ++i) {
+            add(buckets[i], other.buckets[i].load(std::memory_order_relaxed));
+        }
+        add(sum, other.sum.load(std::memory_order_relaxed));
+        min.store(std::min(min.load(std::memory_order_relaxed), other.min.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+        max.store(std::max(max.load(std::memory_order_relaxed), other.max.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+
+    void clear()
+    {
+        for (auto & bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        sum.store(0, std::memory_order_relaxed);
+        min.store(no_min, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+};
+
+using Histograms = std::array<Histogram, operation_count>;
+
+// histograms of the live threads and the sum of those of the exited ones
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<Histograms *> threads;
+    Histograms exited;
+};
+
+Registry & registry()
+{
+    // never destroyed, since threads may still exit after static destruction has begun
+    static Registry * instance = new Registry;
+    return *instance;
+}
+
+// registers the histograms of a thread on its first record() and folds them into the exited
+// sum when the thread ends
+class ThreadHistograms
+{
+public:
+    ThreadHistograms()
+        : m_histograms(std::make_unique<Histograms>())
+    {
+        Registry & all = registry();
+        std::lock_guard lock(all.mutex);
+        all.threads.push_back(m_histograms.get());
+    }
+
+    ~ThreadHistograms()
+    {
+        Registry & all = registry();
+        std::lock_guard lock(all.mutex);
+        for (std::size_t op = 0; op < operation_count; ++op) {
+            all.exited[op].merge((*m_histograms)[op]);
+        }
+        all.threads.erase(std::find(all.threads.begin(), all.threads.end(), m_histograms.get()));
+    }
+
+    Histogram & operator[](Operation operation)
+    {
+        return (*m_histograms)[static_cast<std::size_t>(operation)];
+    }
+
+private:
+    std::unique_ptr<Histograms> m_histograms;
+};
+
+} // anonymous namespace
+
+const char * name(Operation operation)
+{
+    switch (operation) {
+    case Operation::put:
+        return "put";
+    case Operation::contains:
+        return "contains";
+    case Operation::nearest:
+        return "nearest";
+    case Operation::knn:
+        return "knn";
+    case Operation::range:
+        return "range";
+    case Operation::rebuild:
+        return "rebuild";
+    }
+    return "unknown";
+}
+
+std::size_t Snapshot::bucketOf(std::uint64_t nanoseconds)
+{
+    constexpr std::uint64_t linear = std::uint64_t{1} << (sub_bucket_bits + 1);
+    if (nanoseconds < linear) {
+        return nanoseconds;
+    }
+    unsigned shift = std::bit_width(nanoseconds) - (sub_bucket_bits + 1);
+    std::size_t bucket = ((shift + 1) << sub_bucket_bits) + (nanoseconds >> shift) - (linear >> 1);
+    return std::min(bucket, bucket_count - 1);
+}
+
+std::uint64_t Snapshot::upperBound(std::size_t bucket)
+{
+    constexpr std::size_t linear = std::size_t{1} << (sub_bucket_bits + 1);
+    if (bucket < linear) {
+        return bucket;
+    }
+    unsigned shift = (bucket >> sub_bucket_bits) - 1;
+    std::uint64_t mantissa = (bucket & ((std::size_t{1} << sub_bucket_bits) - 1)) + (linear >> 1);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+Snapshot::Snapshot()
+    : m_buckets(bucket_count, 0)
+{
+}
+
+std::uint64_t Snapshot::count() const
+{
+    return m_count;
+}
+
+std::uint64_t Snapshot::min() const
+{
+    return m_min;
+}
+
+std::uint64_t Snapshot::max() const
+{
+    return m_max;
+}
+
+double Snapshot::mean() const
+{
+    return m_count == 0 ? 0 : static_cast<double>(m_sum) / m_count;
+}
+
+std::uint64_t Snapshot::percentile(double percent) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(percent, 0.0, 100.0) / 100 * m_count));
+    if (rank == 0) {
+        return m_min;
+    }
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            return std::min(std::max(upperBound(i), m_min), m_max);
+        }
+    }
+    return m_max;
+}
+
+const std::vector<std::uint64_t> & Snapshot::buckets() const
+{
+    return m_buckets;
+}
+
+Snapshot & Snapshot::operator+=(const Snapshot & other)
+{
+    if (other.m_count == 0) {
+        return *this;
+    }
+    for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_min = m_count == 0 ? other.m_min : std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    return *this;
+}
+
+void record(Operation operation, std::uint64_t nanoseconds)
+{
+    thread_local ThreadHistograms histograms;
+    histograms[operation].record(nanoseconds);
+}
+
+Snapshot snapshot(Operation operation)
+{
+    Snapshot result;
+    std::uint64_t min = no_min;
+    Registry & all = registry();
+    std::lock_guard lock(all.mutex);
+    auto collect = [&](const Histogram & histogram) {
+        for (std::size_t i = 0; i < result.m_buckets.size(); ++i) {
+            result.m_buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+        }
+        result.m_sum += histogram.sum.load(std::memory_order_relaxed);
+        result.m_max = std::max(result.m_max, histogram.max.load(std::memory_order_relaxed));
+        min = std::min(min, histogram.min.load(std::memory_order_relaxed));
+    };
+    auto op = static_cast<std::size_t>(operation);
+    collect(all.exited[op]);
+    for (Histograms * histograms : all.threads) {
+        collect((*histograms)[op]);
+    }
+    // the buckets are read one by one while their threads keep writing, so the count comes
+    // from the buckets read rather than a separate counter to keep percentiles consistent
+    for (std::uint64_t bucket : result.m_buckets) {
+        result.m_count += bucket;
+    }
+    result.m_min = result.m_count == 0 ? 0 : std::min(min, result.m_max);
+    return result;
+}
+
+void reset()
+{
+    Registry & all = registry();
+    std::lock_guard lock(all.mutex);
+    for (auto & histogram : all.exited) {
+        histogram.clear();
+    }
+    for (Histograms * histograms : all.threads) {
+        for (auto & histogram : *histograms) {
+            histogram.clear();
+        }
+    }
+}
+
+} // namespace latency
@@ -0,0 +1,110 @@
+#include "learned.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace learned {
+
+void Model::build(const std::vector<std::uint64_t> & codes)
+{
+    m_segments.clear();
+    if (codes.empty()) {
+        return;
+    }
+    std::size_t count = std::max<std::size_t>(1, codes.size() / keys_per_segment);
+    m_min_key = codes.front();
+    m_root_scale = count / (static_cast<double>(codes.back() - m_min_key) + 1);
+    m_segments.resize(count);
+
+    // the root model is monotone, so every segment receives a contiguous run of codes
+    std::size_t position = 0;
+    for (std::size_t s = 0; s < count; ++s) {
+        Segment & segment = m_segments[s];
+        segment.begin = position;
+        while (position < codes.size() && segmentOf(codes[position]) == s) {
+            ++position;
+        }
+        segment.end = position;
+        segment.first_key = segment.begin < segment.end ? codes[segment.begin] : 0;
+        segment.intercept = static_cast<double>(segment.begin);
+        if (segment.end - segment.begin < 2) {
+            continue;
+        }
+        // least squares fit of position against the key offset inside the segment
+        double n = static_cast<double>(segment.end - segment.begin);
+        double mean_key = 0, mean_pos = 0;
+        for (std::size_t i = segment.begin; i < segment.end; ++i) {
+            mean_key += static_cast<double>(codes[i] - segment.first_key);
+            mean_pos += static_cast<double>(i);
+        }
+        mean_key /= n;
+        mean_pos /= n;
+        double covariance = 0, variance = 0;
+        for (std::size_t i = segment.begin; i < segment.end; ++i) {
+            double dk = static_cast<double>(codes[i] - segment.first_key) - mean_key;
+            covariance += dk * (static_cast<double>(i) - mean_pos);
+            variance += dk * dk;
+        }
+        segment.slope = variance > 0 ? covariance / variance : 0;
+        segment.intercept = mean_pos - segment.slope * mean_key;
+        for (std::size_t i = segment.begin; i < segment.end; ++i) {
+            double error = std::abs(predict(segment, codes[i]) - static_cast<double>(i));
+            segment.error = std::max(segment.error, static_cast<std::size_t>(std::ceil(error)));
+        }
+    }
+}
+
+std::size_t Model::segmentOf(std::uint64_t code) const
+{
+    if (code <= m_min_key) {
+        return 0;
+    }
+    double s = static_cast<double>(code - m_min_key) * m_root_scale;
+    return std::min(m_segments.size() - 1, static_cast<std::size_t>(s));
+}
+
+double Model::predict(const Segment & segment, std::uint64_t code)
+{
+    double offset = code >= segment.first_key ? static_cast<double>(code - segment.first_key) : -static_cast<double>(segment.first_key - code);
+    return segment.intercept + segment.slope * offset;
+}
+
+std::size_t Model::lowerBound(const std::vector<std::uint64_t> & codes, std::uint64_t code, std::size_t first, std::size_t last) const
+{
+    if (m_segments.empty()) {
+        return first;
+    }
+    // codes routed to earlier segments are all smaller and later ones all larger, so the
+    // answer over the whole array lies in [begin, end] of the code's segment
+    const Segment & segment = m_segments[segmentOf(code)];
+    double predicted = predict(segment, code);
+    double slack = static_cast<double>(segment.error) + 1;
+    auto clamp = [&segment](double position) {
+        return static_cast<std::size_t>(std::clamp(position, static_cast<double>(segment.begin), static_cast<double>(segment.end)));
+    };
+    std::size_t window_first = clamp(std::floor(predicted - slack));
+    std::size_t window_last = clamp(std::ceil(predicted + slack) + 1);
+    std::size_t at = std::lower_bound(codes.begin() + window_first, codes.begin() + window_last, code) - codes.begin();
+    bool exact = (at == 0 || codes[at - 1] < code) && (at == codes.size() || codes[at] >= code);
+    if (!exact) {
+        // query codes between two data codes can land just outside the trained error window
+        at = std::lower_bound(codes.begin() + segment.begin, codes.begin() + segment.end, code) - codes.begin();
+    }
+    return std::clamp(at, first, last);
+}
+
+std::size_t Model::segments() const
+{
+    return m_segments.size();
+}
+
+std::size_t Model::maxError() const
+{
+    std::size_t result = 0;
+    for (const auto & segment : m_segments) {
+        result = std::max(result, segment.error);
+    }
+    return result;
+}
+
+} // namespace learned
@@ -1,13 +1,34 @@
+#include "adaptive.h"
+#include "cluster.h"
+#include "delaunay.h"
+#include "grid.h"
+#include "learned.h"
 #include "primitives.h"
+#include "quadtree.h"
+#include "rtree.h"
+#include "vptree.h"
+#include "zorder.h"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <optional>
+#include <ranges>
 #include <set>
+#include <sstream>
+#include <string>
+#include <vector>
 
 using set_t = std::set<Point>;
-template <typename ITER>
-std::set<Point, bool (*)(const Point &, const Point &)> to_set(const std::pair<ITER, ITER> & range)
+template <std::ranges::input_range R>
+std::set<Point, bool (*)(const Point &, const Point &)> to_set(R && range)
 {
     auto cmp = [](const Point & a, const Point & b) {
         if (a.x() == b.x()) {
@@ -16,24 +37,352 @@ std::set<Point, bool (*)(const Point &, const Point &)> to_set(const std::pair<I
         return a.x() < b.x();
     };
     std::set<Point, bool (*)(const Point &, const Point &)> res(cmp);
-    std::copy(range.first, range.second, std::inserter(res, res.begin()));
+    std::ranges::copy(range, std::inserter(res, res.begin()));
     return res;
 }
+
+template <typename PointSet>
+PointSet load(std::vector<Point> points)
+{
+    return PointSet(std::move(points));
+}
+
+template <>
+rbtree::PointSet load(std::vector<Point> points)
+{
+    return rbtree::PointSet(std::set<Point>(points.begin(), points.end()));
+}
+
+template <typename PointSet, typename Expected>
+bool sameRange(const char * name, const std::vector<Point> & input, const Rect & rect, const Expected & expected)
+{
+    PointSet points = load<PointSet>(input);
+    if (!std::ranges::equal(expected, to_set(points.range(rect)))) {
+        std::cout << "Difference in results from rb_tree and " << name << " found\n";
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// answers are handed to stdout in chunks of about this size
+constexpr std::size_t output_chunk = 1 << 16;
+
+enum class Command
+{
+    nearest,
+    knn,
+    range,
+    count,
+};
+
+constexpr std::size_t command_count = 4;
+
+constexpr const char * command_names[command_count] = {"nearest", "knn", "range", "count"};
+
+std::optional<Command> parseCommand(const std::string & word)
+{
+    for (std::size_t i = 0; i < command_count; ++i) {
+        if (word == command_names[i]) {
+            return static_cast<Command>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+// "x y" with the shortest digits that read back as the same doubles
+void appendPoint(std::string & out, const Point & p)
+{
+    char buffer[64];
+    char * end = std::to_chars(buffer, buffer + sizeof(buffer), p.x()).ptr;
+    *end++ = ' ';
+    end = std::to_chars(end, buffer + sizeof(buffer), p.y()).ptr;
+    *end++ = '\n';
+    out.append(buffer, end);
+}
+
+void appendPoints(std::string & out, const PointView & points)
+{
+    out += std::to_string(points.size());
+    out += '\n';
+    for (const Point & p : points) {
+        appendPoint(out, p);
+    }
+}
+
+// count, total, mean and percentiles of the query times of one command, in microseconds
+void reportTimes(const char * name, std::vector<double> & times)
+{
+    if (times.empty()) {
+        return;
+    }
+    std::sort(times.begin(), times.end());
+    double total = 0;
+    for (double t : times) {
+        total += t;
+    }
+    auto percentile = [&times](double p) { return times[std::min(times.size() - 1, static_cast<std::size_t>(p * times.size()))]; };
+    std::cerr << std::left << std::setw(8) << name << std::right << std::setw(10) << times.size() << std::setw(14) << total / 1000
+              << std::setw(12) << total / times.size() << std::setw(12) << percentile(0.5) << std::setw(12) << percentile(0.99)
+              << std::setw(12) << times.back() << "\n";
+}
+
+// Builds the index once, then answers one command per line of `queries`:
+//   nearest x y              the nearest point, or "none"
+//   knn k x y                the number of points found, then one point per line
+//   range x1 y1 x2 y2        the same for the points in the rectangle
+//   count x1 y1 x2 y2        the number of points in the rectangle
+// Empty lines and lines starting with # are skipped; a malformed line is answered with
+// "error" and a reason. Timings go to stderr.
+template <typename PointSet>
+int runBatch(std::vector<Point> points, std::istream & queries)
+{
+    auto start = Clock::now();
+    std::size_t input_size = points.size();
+    PointSet set = load<PointSet>(std::move(points));
+    double build_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::array<std::vector<double>, command_count> times;
+    std::string out;
+    out.reserve(2 * output_chunk);
+    std::size_t line_number = 0, errors = 0;
+    auto queries_start = Clock::now();
+    for (std::string line; std::getline(queries, line);) {
+        ++line_number;
+        std::istringstream in(line);
+        std::string word;
+        if (!(in >> word) || word[0] == '#') {
+            continue;
+        }
+        auto command = parseCommand(word);
+        std::size_t k = 0;
+        std::array<double, 4> args{};
+        std::size_t arity = (command == Command::range || command == Command::count) ? 4 : 2;
+        bool valid = command.has_value() && (command != Command::knn || in >> k);
+        for (std::size_t i = 0; valid && i < arity; ++i) {
+            valid = static_cast<bool>(in >> args[i]);
+        }
+        std::string rest;
+        if (!valid || in >> rest) {
+            out += "error line " + std::to_string(line_number) + ": " + (command ? "usage: " : "unknown command ") + line + "\n";
+            ++errors;
+            continue;
+        }
+
+        auto begin = Clock::now();
+        switch (*command) {
+        case Command::nearest: {
+            auto nearest = set.nearest(Point(args[0], args[1]));
+            times[0].push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+            if (nearest) {
+                appendPoint(out, *nearest);
+            }
+            else {
+                out += "none\n";
+            }
+            break;
+        }
+        case Command::knn: {
+            auto found = set.nearest(Point(args[0], args[1]), k);
+            times[1].push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+            appendPoints(out, found);
+            break;
+        }
+        case Command::range:
+        case Command::count: {
+            Rect rect(Point(std::min(args[0], args[2]), std::min(args[1], args[3])), Point(std::max(args[0], args[2]), std::max(args[1], args[3])));
+            auto found = set.range(rect);
+            times[static_cast<std::size_t>(*command)].push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+            if (*command == Command::range) {
+                appendPoints(out, found);
+            }
+            else {
+                out += std::to_string(found.size()) + "\n";
+            }
+            break;
+        }
+        }
+        if (out.size() >= output_chunk) {
+            std::cout.write(out.data(), out.size());
+            out.clear();
+        }
+    }
+    std::cout.write(out.data(), out.size());
+    std::cout.flush();
+    double queries_ms = std::chrono::duration<double, std::milli>(Clock::now() - queries_start).count();
+
+    std::size_t answered = 0;
+    for (const auto & t : times) {
+        answered += t.size();
+    }
+    std::cerr << "built " << set.size() << " of " << input_size << " points in " << build_ms << " ms\n"
+              << answered << " queries in " << queries_ms << " ms including parsing and output";
+    if (answered > 0) {
+        std::cerr << ", " << queries_ms * 1000 / answered << " us per query";
+    }
+    std::cerr << (errors > 0 ? ", " + std::to_string(errors) + " malformed lines" : "") << "\n"
+              << std::left << std::setw(8) << "command" << std::right << std::setw(10) << "queries" << std::setw(14) << "total ms"
+              << std::setw(12) << "mean us" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "max us" << "\n";
+    for (std::size_t i = 0; i < command_count; ++i) {
+        reportTimes(command_names[i], times[i]);
+    }
+    return errors > 0 ? 1 : 0;
+}
+
+using Batch = int (*)(std::vector<Point>, std::istream &);
+
+const std::vector<std::pair<const char *, Batch>> & batchBackends()
+{
+    static const std::vector<std::pair<const char *, Batch>> all = {
+            {"rb_tree", &runBatch<rbtree::PointSet>},
+            {"kd_tree", &runBatch<kdtree::PointSet>},
+            {"grid", &runBatch<grid::PointSet>},
+            {"r_tree", &runBatch<rtree::PointSet>},
+            {"quad_tree", &runBatch<quadtree::PointSet>},
+            {"z_order", &runBatch<zorder::PointSet<>>},
+            {"learned", &runBatch<learned::PointSet>},
+            {"vp_tree", &runBatch<vptree::PointSet<>>},
+            {"delaunay", &runBatch<delaunay::PointSet>},
+            {"adaptive", &runBatch<adaptive::PointSet>},
+    };
+    return all;
+}
+
+// 2d-tree --batch <input_file> [--backend name] [--queries file]
+int batch(int argc, char ** argv)
+{
+    std::string backend = "kd_tree", queries_file;
+    bool valid = argc % 2 == 1;
+    for (int i = 3; valid && i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--backend") {
+            backend = argv[i + 1];
+        }
+        else if (flag == "--queries") {
+            queries_file = argv[i + 1];
+        }
+        else {
+            valid = false;
+        }
+    }
+    auto it = std::find_if(batchBackends().begin(), batchBackends().end(), [&backend](const auto & entry) { return backend == entry.first; });
+    if (!valid || it == batchBackends().end()) {
+        std::cerr << "usage: " << argv[0] << " --batch <input_file> [--backend name] [--queries file]\n"
+                  << "backends:";
+        for (const auto & entry : batchBackends()) {
+            std::cerr << " " << entry.first;
+        }
+        std::cerr << "\nreads nearest x y / knn k x y / range x1 y1 x2 y2 / count x1 y1 x2 y2 lines from the\n"
+                  << "queries file or stdin and writes one answer per query to stdout\n";
+        return 1;
+    }
+    std::vector<Point> points = readPoints(argv[2]);
+    if (queries_file.empty()) {
+        std::ios::sync_with_stdio(false);
+        return it->second(std::move(points), std::cin);
+    }
+    std::ifstream queries(queries_file);
+    if (!queries) {
+        std::cerr << "cannot open " << queries_file << "\n";
+        return 1;
+    }
+    return it->second(std::move(points), queries);
+}
+
+// 2d-tree --dbscan <input_file> <eps> <min_pts>
+int clusters(int argc, char ** argv)
+{
+    char * eps_end = nullptr;
+    char * min_pts_end = nullptr;
+    double eps = argc == 5 ? std::strtod(argv[3], &eps_end) : 0;
+    unsigned long long min_pts = argc == 5 ? std::strtoull(argv[4], &min_pts_end, 10) : 0;
+    if (argc != 5 || *eps_end != '\0' || *min_pts_end != '\0' || !(eps >= 0)) {
+        std::cerr << "usage: " << argv[0] << " --dbscan <input_file> <eps> <min_pts>\n"
+                  << "writes one \"x y label\" line per point, label -1 marking noise\n";
+        return 1;
+    }
+    auto start = Clock::now();
+    kdtree::PointSet set(readPoints(argv[2]));
+    double build_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    start = Clock::now();
+    cluster::Clustering clustering = cluster::dbscan(set, eps, min_pts);
+    double dbscan_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::string out;
+    out.reserve(2 * output_chunk);
+    for (std::size_t i = 0; i < clustering.points.size(); ++i) {
+        appendPoint(out, clustering.points[i]);
+        out.back() = ' ';
+        out += std::to_string(clustering.labels[i]);
+        out += '\n';
+        if (out.size() >= output_chunk) {
+            std::cout.write(out.data(), out.size());
+            out.clear();
+        }
+    }
+    std::cout.write(out.data(), out.size());
+    std::cout.flush();
+    std::size_t noise_points = std::count(clustering.labels.begin(), clustering.labels.end(), cluster::noise);
+    std::cerr << "built " << set.size() << " points in " << build_ms << " ms\n"
+              << clustering.clusters << " clusters, " << clustering.core_points << " core points, " << noise_points << " noise points in "
+              << dbscan_ms << " ms\n";
+    return 0;
+}
+
+} // anonymous namespace
+
 int main(int argc, char ** argv)
 {
+    if (argc >= 3 && std::string(argv[1]) == "--batch") {
+        return batch(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--dbscan") {
+        return clusters(argc, argv);
+    }
     if (argc != 4 && argc != 6) {
         std::cout << "Wrong amount of arguments. Provide filename and coordinates as arguments. See example below:\n";
         std::cout << "2d-tree test/etc/my_test.dat 1 1 3 5" << std::endl;
+        std::cout << "To answer many queries with one index use: 2d-tree --batch <input_file> [--backend name] [--queries file]" << std::endl;
+        std::cout << "To cluster the points use: 2d-tree --dbscan <input_file> <eps> <min_pts>" << std::endl;
         return 0;
     }
+    // parsed once and copied into every backend
+    const std::vector<Point> points = readPoints(argv[1]);
     if (argc == 4) {
         Point point(std::atof(argv[2]), std::atof(argv[3]));
         // rb_tree running
-        rbtree::PointSet rb_tree(argv[1]);
+        auto rb_tree = load<rbtree::PointSet>(points);
         std::cout << "rb_tree result: " << *rb_tree.nearest(point);
         // kd_tree running
-        kdtree::PointSet kd_tree(argv[1]);
+        auto kd_tree = load<kdtree::PointSet>(points);
         std::cout << "kd_tree result: " << *kd_tree.nearest(point);
+        // grid running
+        auto grid_index = load<grid::PointSet>(points);
+        std::cout << "grid result: " << *grid_index.nearest(point);
+        // r_tree running
+        auto r_tree = load<rtree::PointSet>(points);
+        std::cout << "r_tree result: " << *r_tree.nearest(point);
+        // quad_tree running
+        auto quad_tree = load<quadtree::PointSet>(points);
+        std::cout << "quad_tree result: " << *quad_tree.nearest(point);
+        // z_order running
+        auto z_order = load<zorder::PointSet<>>(points);
+        std::cout << "z_order result: " << *z_order.nearest(point);
+        // learned running
+        auto learned_set = load<learned::PointSet>(points);
+        std::cout << "learned result: " << *learned_set.nearest(point);
+        // vp_tree running
+        auto vp_tree = load<vptree::PointSet<>>(points);
+        std::cout << "vp_tree result: " << *vp_tree.nearest(point);
+        // delaunay running
+        auto delaunay_set = load<delaunay::PointSet>(points);
+        std::cout << "delaunay result: " << *delaunay_set.nearest(point);
+        // adaptive running
+        auto adaptive_set = load<adaptive::PointSet>(points);
+        std::cout << "adaptive result (" << adaptive_set.decision().reason << "): " << *adaptive_set.nearest(point);
     }
     else {
         Point left_bottom(std::atof(argv[2]), std::atof(argv[3]));
@@ -41,10 +390,10 @@ int main(int argc, char ** argv)
         Rect rect(left_bottom, right_top);
 
         // rb_tree running
-        rbtree::PointSet rb_tree(argv[1]);
+        auto rb_tree = load<rbtree::PointSet>(points);
         auto rb_set = to_set(rb_tree.range(rect));
         // kd_tree running
-        kdtree::PointSet kd_tree(argv[1]);
+        auto kd_tree = load<kdtree::PointSet>(points);
         auto kd_set = to_set(kd_tree.range(rect));
         std::cout << "Comparing result from rb_tree and kd_tree:\n";
         auto it1 = rb_set.begin();
@@ -57,13 +406,19 @@ int main(int argc, char ** argv)
             }
             std::cout << i++ << ") " << *it1;
         }
-    }
-
-    kdtree::PointSet tree;
-    tree.put({3, 4});
-    tree.put({4, 0});
-    auto ans = tree.nearest({0, 0});
-    if (ans) {
-        std::cout << ans.value() << "\n";
+        if (rb_set.size() != kd_set.size()) {
+            std::cout << "Difference in results from rb_tree and kd_tree found: " << rb_set.size() << " and " << kd_set.size() << " points\n";
+            return 0;
+        }
+        if (!sameRange<grid::PointSet>("grid", points, rect, rb_set) ||
+            !sameRange<rtree::PointSet>("r_tree", points, rect, rb_set) ||
+            !sameRange<quadtree::PointSet>("quad_tree", points, rect, rb_set) ||
+            !sameRange<zorder::PointSet<>>("z_order", points, rect, rb_set) ||
+            !sameRange<learned::PointSet>("learned", points, rect, rb_set) ||
+            !sameRange<vptree::PointSet<>>("vp_tree", points, rect, rb_set) ||
+            !sameRange<delaunay::PointSet>("delaunay", points, rect, rb_set) ||
+            !sameRange<adaptive::PointSet>("adaptive", points, rect, rb_set)) {
+            return 0;
+        }
     }
 }
@@ -0,0 +1,317 @@
+#include "quadtree.h"
+
+#include "latency.h"
+#include "morton.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace quadtree {
+
+namespace {
+
+constexpr double cells_per_axis = 4294967296.0; // 2^32
+
+std::uint64_t cellStart(std::uint64_t prefix, unsigned level)
+{
+    return level == 0 ? 0 : prefix << (64 - 2 * level);
+}
+
+double boxDistance(const Rect & box, const Point & p)
+{
+    double dx = std::max({box.xmin() - p.x(), 0.0, p.x() - box.xmax()});
+    double dy = std::max({box.ymin() - p.y(), 0.0, p.y() - box.ymax()});
+    return dx * dx + dy * dy;
+}
+
+} // anonymous namespace
+
+PointSet::PointSet(const std::string & filename)
+    : PointSet(readPoints(filename))
+{
+}
+
+PointSet::PointSet(std::vector<Point> points)
+{
+    reBuild(uniquePoints(std::move(points)));
+}
+
+void PointSet::reBuild(std::vector<Point> points)
+{
+    latency::Timer timer(latency::Operation::rebuild);
+    m_leaves.clear();
+    m_size = points.size();
+    if (points.empty()) {
+        m_side = 0;
+        return;
+    }
+    auto [xmin, xmax] = std::minmax_element(points.begin(), points.end(), [](const Point & lhs, const Point & rhs) { return lhs.x() < rhs.x(); });
+    auto [ymin, ymax] = std::minmax_element(points.begin(), points.end(), [](const Point & lhs, const Point & rhs) { return lhs.y() < rhs.y(); });
+    double side = std::max(xmax->x() - xmin->x(), ymax->y() - ymin->y());
+    if (!(side > 0)) {
+        side = std::max(1.0, std::abs(xmin->x()) + std::abs(ymin->y()));
+    }
+    // leave half a side of room around the data, so growth rarely leaves the domain
+    m_side = 2 * side;
+    m_xmin = xmin->x() - side / 2;
+    m_ymin = ymin->y() - side / 2;
+
+    std::vector<std::pair<std::uint64_t, Point>> entries;
+    entries.reserve(points.size());
+    for (const auto & p : points) {
+        entries.emplace_back(code(p), p);
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto & lhs, const auto & rhs) { return lhs.first < rhs.first; });
+    buildLeaves(entries, 0, entries.size(), 0, 0);
+}
+
+void PointSet::buildLeaves(std::vector<std::pair<std::uint64_t, Point>> & entries, std::size_t first, std::size_t last, std::uint64_t prefix, unsigned level)
+{
+    if (last - first <= leaf_capacity || level == max_level) {
+        Leaf leaf{cellStart(prefix, level), level, {}};
+        leaf.points.reserve(last - first);
+        for (std::size_t i = first; i < last; ++i) {
+            leaf.points.push_back(entries[i].second);
+        }
+        m_leaves.push_back(std::move(leaf));
+        return;
+    }
+    std::size_t bounds[5] = {first, 0, 0, 0, last};
+    for (unsigned quadrant = 1; quadrant < 4; ++quadrant) {
+        std::uint64_t start = cellStart(prefix * 4 + quadrant, level + 1);
+        bounds[quadrant] = std::lower_bound(entries.begin() + first, entries.begin() + last, start, [](const auto & entry, std::uint64_t c) { return entry.first < c; }) - entries.begin();
+    }
+    for (unsigned quadrant = 0; quadrant < 4; ++quadrant) {
+        buildLeaves(entries, bounds[quadrant], bounds[quadrant + 1], prefix * 4 + quadrant, level + 1);
+    }
+}
+
+bool PointSet::inDomain(const Point & p) const
+{
+    return p.x() >= m_xmin && p.x() < m_xmin + m_side && p.y() >= m_ymin && p.y() < m_ymin + m_side;
+}
+
+std::uint64_t PointSet::code(const Point & p) const
+{
+    auto quantize = [this](double v, double origin) {
+        double q = std::floor((v - origin) / m_side * cells_per_axis);
+        return static_cast<std::uint32_t>(std::clamp(q, 0.0, cells_per_axis - 1));
+    };
+    return morton::encode(quantize(p.x(), m_xmin), quantize(p.y(), m_ymin));
+}
+
+std::size_t PointSet::leafOf(std::uint64_t c) const
+{
+    auto it = std::upper_bound(m_leaves.begin(), m_leaves.end(), c, [](std::uint64_t value, const Leaf & leaf) { return value < leaf.first; });
+    return (it - m_leaves.begin()) - 1;
+}
+
+void PointSet::split(std::size_t index)
+{
+    unsigned level = m_leaves[index].level + 1;
+    std::uint64_t prefix = m_leaves[index].level == 0 ? 0 : m_leaves[index].first >> (64 - 2 * m_leaves[index].level);
+    std::vector<Point> points = std::move(m_leaves[index].points);
+    std::vector<Leaf> children(4);
+    for (unsigned quadrant = 0; quadrant < 4; ++quadrant) {
+        children[quadrant] = {cellStart(prefix * 4 + quadrant, level), level, {}};
+    }
+    for (const auto & p : points) {
+        children[(code(p) >> (64 - 2 * level)) & 3].points.push_back(p);
+    }
+    m_leaves[index] = std::move(children[0]);
+    m_leaves.insert(m_leaves.begin() + index + 1, std::make_move_iterator(children.begin() + 1), std::make_move_iterator(children.end()));
+    // all points may have landed in one quadrant; go from the back so indices stay valid
+    for (std::size_t quadrant = 4; quadrant-- > 0;) {
+        if (m_leaves[index + quadrant].points.size() > leaf_capacity && level < max_level) {
+            split(index + quadrant);
+        }
+    }
+}
+
+PointSet::Cell PointSet::root() const
+{
+    return {0, 0, 0, m_leaves.size()};
+}
+
+PointSet::Cell PointSet::child(const Cell & cell, unsigned quadrant) const
+{
+    Cell result{cell.prefix * 4 + quadrant, cell.level + 1, cell.first, cell.last};
+    auto first_leaf = m_leaves.begin() + cell.first;
+    auto last_leaf = m_leaves.begin() + cell.last;
+    auto before = [](const Leaf & leaf, std::uint64_t c) { return leaf.first < c; };
+    if (quadrant > 0) {
+        result.first = std::lower_bound(first_leaf, last_leaf, cellStart(result.prefix, result.level), before) - m_leaves.begin();
+    }
+    if (quadrant < 3) {
+        result.last = std::lower_bound(first_leaf, last_leaf, cellStart(result.prefix + 1, result.level), before) - m_leaves.begin();
+    }
+    return result;
+}
+
+Rect PointSet::bounds(const Cell & cell) const
+{
+    std::uint64_t low = cellStart(cell.prefix, cell.level);
+    double step = m_side / cells_per_axis;
+    double width = std::ldexp(m_side, -static_cast<int>(cell.level));
+    double x = m_xmin + morton::decodeX(low) * step;
+    double y = m_ymin + morton::decodeY(low) * step;
+    return Rect({x - step, y - step}, {x + width + step, y + width + step});
+}
+
+bool PointSet::empty() const
+{
+    return m_size == 0;
+}
+
+std::size_t PointSet::size() const
+{
+    return m_size;
+}
+
+void PointSet::put(const Point & p)
+{
+    if (contains(p)) {
+        return;
+    }
+    if (m_leaves.empty() || !inDomain(p)) {
+        std::vector<Point> points(begin(), end());
+        points.push_back(p);
+        reBuild(std::move(points));
+        return;
+    }
+    std::size_t leaf = leafOf(code(p));
+    m_leaves[leaf].points.push_back(p);
+    ++m_size;
+    if (m_leaves[leaf].points.size() > leaf_capacity && m_leaves[leaf].level < max_level) {
+        split(leaf);
+    }
+}
+
+bool PointSet::contains(const Point & p) const
+{
+    if (m_leaves.empty() || !inDomain(p)) {
+        return false;
+    }
+    const auto & points = m_leaves[leafOf(code(p))].points;
+    return std::find(points.begin(), points.end(), p) != points.end();
+}
+
+template <typename Visit>
+void PointSet::rangeCells(const Cell & cell, const Rect & rect, Visit && visit) const
+{
+    Rect box = bounds(cell);
+    if (!box.intersects(rect)) {
+        return;
+    }
+    bool inside = box.xmin() >= rect.xmin() && box.xmax() <= rect.xmax() && box.ymin() >= rect.ymin() && box.ymax() <= rect.ymax();
+    if (inside || cell.last - cell.first == 1) {
+        for (std::size_t i = cell.first; i < cell.last; ++i) {
+            visit(m_leaves[i], inside);
+        }
+        return;
+    }
+    for (unsigned quadrant = 0; quadrant < 4; ++quadrant) {
+        rangeCells(child(cell, quadrant), rect, visit);
+    }
+}
+
+PointView PointSet::range(const Rect & rect) const
+{
+    std::vector<Point> in_rect;
+    if (m_leaves.empty()) {
+        return {};
+    }
+    rangeCells(root(), rect, [&](const Leaf & leaf, bool inside) {
+        for (const auto & p : leaf.points) {
+            if (inside || rect.contains(p)) {
+                in_rect.push_back(p);
+            }
+        }
+    });
+    return PointView(std::move(in_rect));
+}
+
+PointSet::iterator PointSet::begin() const
+{
+    return {m_leaves.data(), m_leaves.data() + m_leaves.size()};
+}
+
+PointSet::iterator PointSet::end() const
+{
+    return {m_leaves.data() + m_leaves.size(), m_leaves.data() + m_leaves.size()};
+}
+
+void PointSet::searchNearest(const Cell & cell, const Point & p, std::size_t k, std::vector<std::pair<double, const Point *>> & best) const
+{
+    auto bound = [&] { return best.size() < k ? std::numeric_limits<double>::infinity() : best.front().first; };
+    if (cell.last - cell.first == 1) {
+        for (const auto & candidate : m_leaves[cell.first].points) {
+            double dist = squaredDistance(candidate, p);
+            if (dist >= bound()) {
+                continue;
+            }
+            if (best.size() == k) {
+                std::pop_heap(best.begin(), best.end());
+                best.pop_back();
+            }
+            best.emplace_back(dist, &candidate);
+            std::push_heap(best.begin(), best.end());
+        }
+        return;
+    }
+    // visit the quadrants closest first
+    std::pair<double, Cell> children[4];
+    for (unsigned quadrant = 0; quadrant < 4; ++quadrant) {
+        children[quadrant].second = child(cell, quadrant);
+        children[quadrant].first = boxDistance(bounds(children[quadrant].second), p);
+    }
+    std::sort(std::begin(children), std::end(children), [](const auto & lhs, const auto & rhs) { return lhs.first < rhs.first; });
+    for (const auto & [dist, next] : children) {
+        if (dist >= bound()) {
+            break;
+        }
+        searchNearest(next, p, k, best);
+    }
+}
+
+std::optional<Point> PointSet::nearest(const Point & point) const
+{
+    if (empty()) {
+        return std::nullopt;
+    }
+    std::vector<std::pair<double, const Point *>> best;
+    searchNearest(root(), point, 1, best);
+    return *best.front().second;
+}
+
+PointView PointSet::nearest(const Point & point, std::size_t k) const
+{
+    if (k >= size()) {
+        return PointView(std::vector<Point>(begin(), end()));
+    }
+    if (k == 0) {
+        return {};
+    }
+    std::vector<std::pair<double, const Point *>> best;
+    best.reserve(k + 1);
+    searchNearest(root(), point, k, best);
+    std::sort_heap(best.begin(), best.end());
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
+    for (const auto & candidate : best) {
+        neighbours.push_back(*candidate.second);
+    }
+    return PointView(std::move(neighbours));
+}
+
+std::ostream & operator<<(std::ostream & strm, const PointSet & points)
+{
+    for (auto it = points.begin(); it != points.end(); it++) {
+        strm << *it;
+    }
+    return strm;
+}
+
+} // namespace quadtree
@@ -0,0 +1,358 @@
+#include "rtree.h"
+
+#include "latency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+namespace rtree {
+
+namespace {
+
+struct Box
+{
+    double xmin = std::numeric_limits<double>::infinity();
+    double ymin = std::numeric_limits<double>::infinity();
+    double xmax = -std::numeric_limits<double>::infinity();
+    double ymax = -std::numeric_limits<double>::infinity();
+
+    void extend(const Box & other)
+    {
+        xmin = std::min(xmin, other.xmin);
+        ymin = std::min(ymin, other.ymin);
+        xmax = std::max(xmax, other.xmax);
+        ymax = std::max(ymax, other.ymax);
+    }
+};
+
+// Sort-Tile-Recursive order of `boxes`: sqrt(n / fanout) vertical slices by centre x,
+// each slice sorted by centre y
+std::vector<std::size_t> strOrder(const std::vector<Box> & boxes, std::size_t fanout)
+{
+    std::vector<std::size_t> order(boxes.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto cx = [&](std::size_t i) { return boxes[i].xmin + boxes[i].xmax; };
+    auto cy = [&](std::size_t i) { return boxes[i].ymin + boxes[i].ymax; };
+    std::sort(order.begin(), order.end(), [&](std::size_t lhs, std::size_t rhs) { return cx(lhs) < cx(rhs); });
+    std::size_t parents = (boxes.size() + fanout - 1) / fanout;
+    std::size_t slices = std::max<std::size_t>(1, std::ceil(std::sqrt(static_cast<double>(parents))));
+    std::size_t slice = std::max<std::size_t>(1, (parents + slices - 1) / slices) * fanout;
+    for (std::size_t start = 0; start < order.size(); start += slice) {
+        auto last = order.begin() + std::min(start + slice, order.size());
+        std::sort(order.begin() + start, last, [&](std::size_t lhs, std::size_t rhs) { return cy(lhs) < cy(rhs); });
+    }
+    return order;
+}
+
+double boxDistance(const Point & p, double xmin, double ymin, double xmax, double ymax)
+{
+    double dx = std::max({xmin - p.x(), 0.0, p.x() - xmax});
+    double dy = std::max({ymin - p.y(), 0.0, p.y() - ymax});
+    return dx * dx + dy * dy;
+}
+
+} // anonymous namespace
+
+PointSet::PointSet(const std::string & filename)
+    : PointSet(readPoints(filename))
+{
+}
+
+PointSet::PointSet(std::vector<Point> points)
+    : m_points(uniquePoints(std::move(points)))
+{
+    reBuild();
+}
+
+void PointSet::reBuild()
+{
+    latency::Timer timer(latency::Operation::rebuild);
+    m_nodes.clear();
+    m_indexed = m_points.size();
+    if (m_points.empty()) {
+        return;
+    }
+    // leaf level: order the points themselves, then cut them into groups of fanout
+    std::vector<Box> boxes(m_points.size());
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        boxes[i] = {m_points[i].x(), m_points[i].y(), m_points[i].x(), m_points[i].y()};
+    }
+    std::vector<Point> ordered;
+    ordered.reserve(m_points.size());
+    for (std::size_t i : strOrder(boxes, fanout)) {
+        ordered.push_back(m_points[i]);
+    }
+    m_points.swap(ordered);
+    ordered.clear();
+
+    std::vector<Box> groups((m_points.size() + fanout - 1) / fanout);
+    for (std::size_t g = 0; g < groups.size(); ++g) {
+        auto [first, last] = group(g);
+        for (std::size_t i = first; i < last; ++i) {
+            groups[g].extend({m_points[i].x(), m_points[i].y(), m_points[i].x(), m_points[i].y()});
+        }
+    }
+    // tile the groups as well; a short last group has to stay last for group() to hold
+    std::size_t full = m_points.size() / fanout;
+    std::vector<std::size_t> group_order = strOrder({groups.begin(), groups.begin() + full}, fanout);
+    if (full < groups.size()) {
+        group_order.push_back(full);
+    }
+    std::vector<Box> tiled;
+    tiled.reserve(groups.size());
+    for (std::size_t g : group_order) {
+        auto [first, last] = group(g);
+        ordered.insert(ordered.end(), m_points.begin() + first, m_points.begin() + last);
+        tiled.push_back(groups[g]);
+    }
+    m_points = std::move(ordered);
+    groups = std::move(tiled);
+
+    std::vector<Node> level;
+    boxes.clear();
+    for (std::size_t first = 0; first < groups.size(); first += fanout) {
+        Node node;
+        node.leaf = true;
+        node.first = first;
+        node.count = std::min(fanout, groups.size() - first);
+        Box box;
+        for (std::size_t i = 0; i < node.count; ++i) {
+            const Box & child = groups[first + i];
+            node.xmin[i] = child.xmin;
+            node.ymin[i] = child.ymin;
+            node.xmax[i] = child.xmax;
+            node.ymax[i] = child.ymax;
+            box.extend(child);
+        }
+        level.push_back(node);
+        boxes.push_back(box);
+    }
+    // upper levels: order the level, append it to m_nodes and pack its parents
+    while (level.size() > 1) {
+        std::vector<std::size_t> order = strOrder(boxes, fanout);
+        std::size_t base = m_nodes.size();
+        std::vector<Box> placed;
+        placed.reserve(order.size());
+        for (std::size_t i : order) {
+            m_nodes.push_back(level[i]);
+            placed.push_back(boxes[i]);
+        }
+        level.clear();
+        boxes.clear();
+        for (std::size_t first = 0; first < placed.size(); first += fanout) {
+            Node node;
+            node.first = base + first;
+            node.count = std::min(fanout, placed.size() - first);
+            Box box;
+            for (std::size_t i = 0; i < node.count; ++i) {
+                const Box & child = placed[first + i];
+                node.xmin[i] = child.xmin;
+                node.ymin[i] = child.ymin;
+                node.xmax[i] = child.xmax;
+                node.ymax[i] = child.ymax;
+                box.extend(child);
+            }
+            level.push_back(node);
+            boxes.push_back(box);
+        }
+    }
+    // the root is the last node
+    m_nodes.push_back(level.front());
+}
+
+std::pair<std::size_t, std::size_t> PointSet::group(std::size_t g) const
+{
+    return {g * fanout, std::min((g + 1) * fanout, m_indexed)};
+}
+
+bool PointSet::empty() const
+{
+    return m_points.empty();
+}
+
+std::size_t PointSet::size() const
+{
+    return m_points.size();
+}
+
+void PointSet::put(const Point & p)
+{
+    if (contains(p)) {
+        return;
+    }
+    m_points.push_back(p);
+    // points outside the indexed part are scanned linearly, so keep that tail short
+    if (m_points.size() - m_indexed > std::max<std::size_t>(16, m_indexed / 8)) {
+        reBuild();
+    }
+}
+
+bool PointSet::contains(const Point & p) const
+{
+    if (std::find(m_points.begin() + m_indexed, m_points.end(), p) != m_points.end()) {
+        return true;
+    }
+    if (m_nodes.empty()) {
+        return false;
+    }
+    std::vector<std::size_t> stack{m_nodes.size() - 1};
+    while (!stack.empty()) {
+        const Node & node = m_nodes[stack.back()];
+        stack.pop_back();
+        for (std::size_t i = 0; i < node.count; ++i) {
+            if (p.x() < node.xmin[i] || p.x() > node.xmax[i] || p.y() < node.ymin[i] || p.y() > node.ymax[i]) {
+                continue;
+            }
+            if (!node.leaf) {
+                stack.push_back(node.first + i);
+                continue;
+            }
+            auto [first, last] = group(node.first + i);
+            if (std::find(m_points.begin() + first, m_points.begin() + last, p) != m_points.begin() + last) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+PointView PointSet::range(const Rect & rect) const
+{
+    std::vector<Point> in_rect;
+    for (std::size_t i = m_indexed; i < m_points.size(); ++i) {
+        if (rect.contains(m_points[i])) {
+            in_rect.push_back(m_points[i]);
+        }
+    }
+    if (m_nodes.empty()) {
+        return PointView(std::move(in_rect));
+    }
+    std::vector<std::size_t> stack{m_nodes.size() - 1};
+    while (!stack.empty()) {
+        const Node & node = m_nodes[stack.back()];
+        stack.pop_back();
+        for (std::size_t i = 0; i < node.count; ++i) {
+            if (node.xmin[i] > rect.xmax() || node.xmax[i] < rect.xmin() || node.ymin[i] > rect.ymax() || node.ymax[i] < rect.ymin()) {
+                continue;
+            }
+            if (!node.leaf) {
+                stack.push_back(node.first + i);
+                continue;
+            }
+            auto [first, last] = group(node.first + i);
+            bool inside = node.xmin[i] >= rect.xmin() && node.xmax[i] <= rect.xmax() && node.ymin[i] >= rect.ymin() && node.ymax[i] <= rect.ymax();
+            for (std::size_t j = first; j < last; ++j) {
+                if (inside || rect.contains(m_points[j])) {
+                    in_rect.push_back(m_points[j]);
+                }
+            }
+        }
+    }
+    return PointView(std::move(in_rect));
+}
+
+PointSet::iterator PointSet::begin() const
+{
+    return m_points.begin();
+}
+
+PointSet::iterator PointSet::end() const
+{
+    return m_points.end();
+}
+
+double PointSet::Candidates::bound() const
+{
+    return heap.size() < k ? std::numeric_limits<double>::infinity() : heap.front().first;
+}
+
+void PointSet::Candidates::offer(double dist, std::size_t index)
+{
+    if (heap.size() == k) {
+        if (dist >= heap.front().first) {
+            return;
+        }
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+    }
+    heap.emplace_back(dist, index);
+    std::push_heap(heap.begin(), heap.end());
+}
+
+void PointSet::searchNearest(std::size_t index, const Point & point, Candidates & best) const
+{
+    const Node & node = m_nodes[index];
+    // visit children closest first, so the bound shrinks before the far ones are tested
+    std::array<std::pair<double, std::size_t>, fanout> order;
+    for (std::size_t i = 0; i < node.count; ++i) {
+        order[i] = {boxDistance(point, node.xmin[i], node.ymin[i], node.xmax[i], node.ymax[i]), i};
+    }
+    std::sort(order.begin(), order.begin() + node.count);
+    for (std::size_t j = 0; j < node.count && order[j].first < best.bound(); ++j) {
+        std::size_t child = node.first + order[j].second;
+        if (!node.leaf) {
+            searchNearest(child, point, best);
+            continue;
+        }
+        auto [first, last] = group(child);
+        for (std::size_t i = first; i < last; ++i) {
+            best.offer(squaredDistance(m_points[i], point), i);
+        }
+    }
+}
+
+std::vector<std::size_t> PointSet::nearestIndices(const Point & point, std::size_t k) const
+{
+    Candidates best{k, {}};
+    best.heap.reserve(k + 1);
+    for (std::size_t i = m_indexed; i < m_points.size(); ++i) {
+        best.offer(squaredDistance(m_points[i], point), i);
+    }
+    if (!m_nodes.empty()) {
+        searchNearest(m_nodes.size() - 1, point, best);
+    }
+    std::sort_heap(best.heap.begin(), best.heap.end());
+    std::vector<std::size_t> indices;
+    indices.reserve(best.heap.size());
+    for (const auto & candidate : best.heap) {
+        indices.push_back(candidate.second);
+    }
+    return indices;
+}
+
+std::optional<Point> PointSet::nearest(const Point & point) const
+{
+    if (empty()) {
+        return std::nullopt;
+    }
+    return m_points[nearestIndices(point, 1).front()];
+}
+
+PointView PointSet::nearest(const Point & point, std::size_t k) const
+{
+    if (k >= size()) {
+        return PointView(std::vector<Point>(begin(), end()));
+    }
+    if (k == 0) {
+        return {};
+    }
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
+    for (std::size_t i : nearestIndices(point, k)) {
+        neighbours.push_back(m_points[i]);
+    }
+    return PointView(std::move(neighbours));
+}
+
+std::ostream & operator<<(std::ostream & strm, const PointSet & points)
+{
+    for (auto it = points.begin(); it != points.end(); it++) {
+        strm << *it;
+    }
+    return strm;
+}
+
+} // namespace rtree
@@ -0,0 +1,428 @@
+#include "primitives.h"
+#include "protocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// bytes read from a connection per readiness event
+constexpr std::size_t read_chunk = 1 << 16;
+constexpr int max_events = 64;
+
+struct Options
+{
+    std::string socket;
+    // files to build the indexes from, addressed by position in requests
+    std::vector<std::string> indexes;
+    std::size_t workers = std::max(1u, std::thread::hardware_concurrency());
+};
+
+// written by the signal handler to wake every worker
+int stop_fd = -1;
+
+void requestStop(int)
+{
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = write(stop_fd, &one, sizeof(one));
+}
+
+struct Connection
+{
+    int fd;
+    std::vector<char> input;
+    std::vector<char> output;
+    // bytes of `output` already sent
+    std::size_t sent = 0;
+    // the input is garbage from here on; close once the output is sent
+    bool closing = false;
+    bool watching_output = false;
+};
+
+// Runs an epoll loop over the listening socket, the stop event and the connections it accepted.
+// Every worker watches the listening socket with EPOLLEXCLUSIVE, so the kernel wakes one of them
+// per new connection, and the connection stays with that worker.
+class Worker
+{
+public:
+    Worker(const std::vector<kdtree::PointSet> & indexes, int listen_fd)
+        : m_indexes(indexes)
+        , m_listen_fd(listen_fd)
+        , m_epoll(epoll_create1(EPOLL_CLOEXEC))
+    {
+        watch(m_listen_fd, EPOLLIN | EPOLLEXCLUSIVE);
+        watch(stop_fd, EPOLLIN);
+    }
+    ~Worker()
+    {
+        for (auto & [fd, connection] : m_connections) {
+            close(fd);
+        }
+        close(m_epoll);
+    }
+    Worker(const Worker &) = delete;
+    Worker & operator=(const Worker &) = delete;
+
+    void run()
+    {
+        epoll_event events[max_events];
+        while (true) {
+            int ready = epoll_wait(m_epoll, events, max_events, -1);
+            if (ready < 0 && errno != EINTR) {
+                std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == stop_fd) {
+                    return;
+                }
+                if (fd == m_listen_fd) {
+                    acceptAll();
+                    continue;
+                }
+                auto it = m_connections.find(fd);
+                if (it == m_connections.end()) {
+                    continue;
+                }
+                Connection & connection = *it->second;
+                bool open = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    open = receive(connection);
+                }
+                if (open) {
+                    open = flush(connection);
+                }
+                if (!open) {
+                    drop(connection);
+                }
+            }
+        }
+    }
+
+    std::size_t requests() const
+    {
+        return m_requests;
+    }
+
+private:
+    const std::vector<kdtree::PointSet> & m_indexes;
+    int m_listen_fd;
+    int m_epoll;
+    std::unordered_map<int, std::unique_ptr<Connection>> m_connections;
+    std::size_t m_requests = 0;
+
+    void watch(int fd, std::uint32_t events)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void acceptAll()
+    {
+        while (true) {
+            int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                // EAGAIN: another worker took it or the queue is empty
+                return;
+            }
+            m_connections.emplace(fd, std::make_unique<Connection>(Connection{fd, {}, {}, 0, false, false}));
+            watch(fd, EPOLLIN);
+        }
+    }
+
+    void drop(Connection & connection)
+    {
+        int fd = connection.fd;
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        m_connections.erase(fd);
+    }
+
+    // reads what is available and answers every complete request; false once the peer is gone
+    bool receive(Connection & connection)
+    {
+        if (connection.closing) {
+            return true;
+        }
+        std::size_t used = connection.input.size();
+        connection.input.resize(used + read_chunk);
+        ssize_t got = read(connection.fd, connection.input.data() + used, read_chunk);
+        if (got <= 0) {
+            connection.input.resize(used);
+            return got < 0 && (errno == EAGAIN || errno == EINTR);
+        }
+        connection.input.resize(used + got);
+
+        std::size_t offset = 0;
+        while (connection.input.size() - offset >= sizeof(protocol::RequestHeader)) {
+            protocol::RequestHeader header;
+            std::memcpy(&header, connection.input.data() + offset, sizeof(header));
+            if (header.size < sizeof(header) || header.size > protocol::max_request_size) {
+                respond(connection, header.id, protocol::Status::bad_request, 0);
+                connection.closing = true;
+                break;
+            }
+            if (connection.input.size() - offset < header.size) {
+                break;
+            }
+            double arguments[4] = {};
+            std::memcpy(arguments, connection.input.data() + offset + sizeof(header), header.size - sizeof(header));
+            answer(connection, header, arguments);
+            offset += header.size;
+            ++m_requests;
+        }
+        connection.input.erase(connection.input.begin(), connection.input.begin() + offset);
+        return true;
+    }
+
+    void answer(Connection & connection, const protocol::RequestHeader & header, const double * args)
+    {
+        std::size_t arguments = protocol::argumentCount(header.operation);
+        if (arguments == 0) {
+            respond(connection, header.id, protocol::Status::unknown_operation, 0);
+            return;
+        }
+        if (header.size != sizeof(header) + arguments * sizeof(double)) {
+            respond(connection, header.id, protocol::Status::bad_request, 0);
+            return;
+        }
+        if (header.index >= m_indexes.size()) {
+            respond(connection, header.id, protocol::Status::unknown_index, 0);
+            return;
+        }
+        const kdtree::PointSet & index = m_indexes[header.index];
+        Point point(args[0], args[1]);
+        auto rect = [args] {
+            return Rect(Point(std::min(args[0], args[2]), std::min(args[1], args[3])), Point(std::max(args[0], args[2]), std::max(args[1], args[3])));
+        };
+        switch (header.operation) {
+        case protocol::Operation::nearest: {
+            auto nearest = index.nearest(point);
+            respond(connection, header.id, protocol::Status::ok, nearest ? 1 : 0);
+            if (nearest) {
+                appendPoint(connection, *nearest);
+            }
+            break;
+        }
+        case protocol::Operation::knn:
+            respondPoints(connection, header.id, index.nearest(point, std::min<std::size_t>(header.k, index.size())));
+            break;
+        case protocol::Operation::range:
+            respondPoints(connection, header.id, index.range(rect()));
+            break;
+        case protocol::Operation::count:
+            respond(connection, header.id, protocol::Status::ok, 0, index.range(rect()).size());
+            break;
+        case protocol::Operation::contains:
+            respond(connection, header.id, protocol::Status::ok, 0, index.contains(point));
+            break;
+        }
+    }
+
+    // appends a response header announcing `points` points, or carrying `count` without points
+    void respond(Connection & connection, std::uint32_t id, protocol::Status status, std::size_t points, std::size_t count = 0)
+    {
+        protocol::ResponseHeader header{};
+        header.size = static_cast<std::uint32_t>(sizeof(header) + points * 2 * sizeof(double));
+        header.id = id;
+        header.status = status;
+        header.count = static_cast<std::uint32_t>(points > 0 ? points : count);
+        const char * bytes = reinterpret_cast<const char *>(&header);
+        connection.output.insert(connection.output.end(), bytes, bytes + sizeof(header));
+    }
+
+    void respondPoints(Connection & connection, std::uint32_t id, const PointView & points)
+    {
+        respond(connection, id, protocol::Status::ok, points.size(), 0);
+        for (const Point & p : points) {
+            appendPoint(connection, p);
+        }
+    }
+
+    static void appendPoint(Connection & connection, const Point & p)
+    {
+        double coordinates[2] = {p.x(), p.y()};
+        const char * bytes = reinterpret_cast<const char *>(coordinates);
+        connection.output.insert(connection.output.end(), bytes, bytes + sizeof(coordinates));
+    }
+
+    static std::size_t pending(const Connection & connection)
+    {
+        return connection.output.size() - connection.sent;
+    }
+
+    // sends what the socket takes and watches for writability while something is left;
+    // false once the connection should close
+    bool flush(Connection & connection)
+    {
+        while (pending(connection) > 0) {
+            ssize_t sent = send(connection.fd, connection.output.data() + connection.sent, pending(connection), MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN) {
+                    return false;
+                }
+                break;
+            }
+            connection.sent += sent;
+        }
+        if (pending(connection) == 0) {
+            connection.output.clear();
+            connection.sent = 0;
+            if (connection.closing) {
+                return false;
+            }
+        }
+        // while output is stuck the connection waits for EPOLLOUT only, so a client that does
+        // not read cannot make the server buffer ever more responses
+        bool stuck = pending(connection) > 0;
+        if (stuck != connection.watching_output) {
+            epoll_event event{};
+            event.events = stuck ? EPOLLOUT : EPOLLIN;
+            event.data.fd = connection.fd;
+            epoll_ctl(m_epoll, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.watching_output = stuck;
+        }
+        return true;
+    }
+};
+
+int listenOn(const std::string & path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "socket path too long: " << path << std::endl;
+        return -1;
+    }
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    // a socket left behind by an earlier server, but never any other kind of file
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path.c_str());
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        std::cerr << path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+void usage(const char * program)
+{
+    std::cerr << "usage: " << program << " --socket <path> --index <input_file> [--index <input_file> ...] [--workers N]\n"
+              << "builds a kd-tree per input file and answers the binary requests of protocol.h on a\n"
+              << "Unix domain socket with N epoll workers (default: one per core) until SIGINT or SIGTERM\n";
+}
+
+bool parse(int argc, char ** argv, Options & options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (flag == "--socket") {
+            options.socket = value;
+        }
+        else if (flag == "--index") {
+            options.indexes.push_back(value);
+        }
+        else if (flag == "--workers") {
+            options.workers = std::stoull(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return !options.socket.empty() && !options.indexes.empty() && options.indexes.size() <= 256 && options.workers > 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    try {
+        if (!parse(argc, argv, options)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<kdtree::PointSet> indexes;
+    indexes.reserve(options.indexes.size());
+    for (const auto & file : options.indexes) {
+        auto start = Clock::now();
+        const auto & index = indexes.emplace_back(readPoints(file));
+        std::cerr << "index " << indexes.size() - 1 << ": " << index.size() << " points from " << file << " in "
+                  << std::chrono::duration<double, std::milli>(Clock::now() - start).count() << " ms" << std::endl;
+    }
+
+    int listen_fd = listenOn(options.socket);
+    if (listen_fd < 0) {
+        return 1;
+    }
+    stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct sigaction action{};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (std::size_t i = 0; i < options.workers; ++i) {
+        workers.push_back(std::make_unique<Worker>(indexes, listen_fd));
+    }
+    std::cerr << "serving on " << options.socket << " with " << options.workers << " workers" << std::endl;
+    std::vector<std::thread> threads;
+    for (auto & worker : workers) {
+        threads.emplace_back(&Worker::run, worker.get());
+    }
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    std::size_t requests = 0;
+    for (const auto & worker : workers) {
+        requests += worker->requests();
+    }
+    workers.clear();
+    close(listen_fd);
+    close(stop_fd);
+    unlink(options.socket.c_str());
+    std::cerr << "stopped after " << requests << " requests" << std::endl;
+    return 0;
+}
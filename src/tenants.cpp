@@ -0,0 +1,339 @@
+#include "tenants.h"
+
+#include "kernels.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace tenants {
+
+namespace {
+
+template <std::size_t Axis>
+double coord(const Point & p)
+{
+    if constexpr (Axis == 0) {
+        return p.x();
+    }
+    else {
+        return p.y();
+    }
+}
+
+// per-thread buffers of the batch kernels
+struct Scratch
+{
+    std::vector<double> distances;
+    std::unique_ptr<bool[]> mask;
+    std::size_t mask_size = 0;
+
+    bool * maskOf(std::size_t size)
+    {
+        if (mask_size < size) {
+            mask = std::make_unique<bool[]>(size);
+            mask_size = size;
+        }
+        return mask.get();
+    }
+};
+
+thread_local Scratch scratch;
+
+// The queries below walk an implicit kd-tree over [begin, end): the middle point splits on
+// Axis, everything before it is not greater along Axis and everything after it not smaller.
+// Ranges of at most `leaf` points are scanned.
+
+template <std::size_t Axis>
+bool containsIn(const Point * begin, const Point * end, const Point & p, std::size_t leaf)
+{
+    constexpr double eps = std::numeric_limits<double>::epsilon();
+    if (static_cast<std::size_t>(end - begin) <= leaf) {
+        return std::find(begin, end, p) != end;
+    }
+    const Point * middle = begin + (end - begin) / 2;
+    if (*middle == p) {
+        return true;
+    }
+    // equal points compare within eps, so both sides may hold one near the split
+    double split = coord<Axis>(*middle);
+    if (coord<Axis>(p) <= split + eps && containsIn<1 - Axis>(begin, middle, p, leaf)) {
+        return true;
+    }
+    return coord<Axis>(p) >= split - eps && containsIn<1 - Axis>(middle + 1, end, p, leaf);
+}
+
+template <std::size_t Axis>
+void rangeIn(const Point * begin, const Point * end, const Rect & rect, std::size_t leaf, std::vector<Point> & out)
+{
+    if (static_cast<std::size_t>(end - begin) <= leaf) {
+        std::copy_if(begin, end, std::back_inserter(out), [&rect](const Point & p) { return rect.contains(p); });
+        return;
+    }
+    const Point * middle = begin + (end - begin) / 2;
+    double split = coord<Axis>(*middle);
+    if (rect.min<Axis>() <= split) {
+        rangeIn<1 - Axis>(begin, middle, rect, leaf, out);
+    }
+    if (rect.contains(*middle)) {
+        out.push_back(*middle);
+    }
+    if (rect.max<Axis>() >= split) {
+        rangeIn<1 - Axis>(middle + 1, end, rect, leaf, out);
+    }
+}
+
+// `best` is a max-heap of the k closest (squared distance, point) pairs found so far
+template <std::size_t Axis>
+void nearestIn(const Point * begin, const Point * end, const Point & p, std::size_t k, std::size_t leaf, std::vector<std::pair<double, const Point *>> & best)
+{
+    auto offer = [&](const Point & q) {
+        double distance = squaredDistance(p, q);
+        if (best.size() < k) {
+            best.emplace_back(distance, &q);
+            std::push_heap(best.begin(), best.end());
+        }
+        else if (distance < best.front().first) {
+            std::pop_heap(best.begin(), best.end());
+            best.back() = {distance, &q};
+            std::push_heap(best.begin(), best.end());
+        }
+    };
+    if (static_cast<std::size_t>(end - begin) <= leaf) {
+        std::for_each(begin, end, offer);
+        return;
+    }
+    const Point * middle = begin + (end - begin) / 2;
+    double delta = coord<Axis>(p) - coord<Axis>(*middle);
+    offer(*middle);
+    if (delta <= 0) {
+        nearestIn<1 - Axis>(begin, middle, p, k, leaf, best);
+        if (best.size() < k || delta * delta < best.front().first) {
+            nearestIn<1 - Axis>(middle + 1, end, p, k, leaf, best);
+        }
+    }
+    else {
+        nearestIn<1 - Axis>(middle + 1, end, p, k, leaf, best);
+        if (best.size() < k || delta * delta < best.front().first) {
+            nearestIn<1 - Axis>(begin, middle, p, k, leaf, best);
+        }
+    }
+}
+
+} // anonymous namespace
+
+Registry::Registry(const Options & options)
+    : m_options(options)
+{
+    m_options.leaf_size = std::max<std::size_t>(m_options.leaf_size, 1);
+}
+
+Handle Registry::add(std::vector<Point> points)
+{
+    points = uniquePoints(std::move(points));
+    std::uint32_t index;
+    if (m_free.empty()) {
+        index = static_cast<std::uint32_t>(m_slots.size());
+        m_slots.emplace_back();
+    }
+    else {
+        index = m_free.back();
+        m_free.pop_back();
+        ++m_slots[index].generation;
+    }
+    Slot & slot = m_slots[index];
+    slot.offset = m_arena.size();
+    slot.size = static_cast<std::uint32_t>(points.size());
+    m_arena.insert(m_arena.end(), points.begin(), points.end());
+    m_live_points += points.size();
+    if (!bruteForce(slot)) {
+        build(m_arena.data() + slot.offset, m_arena.data() + slot.offset + slot.size, 0);
+    }
+    return {index, slot.generation};
+}
+
+bool Registry::remove(Handle handle)
+{
+    if (find(handle) == nullptr) {
+        return false;
+    }
+    Slot & slot = m_slots[handle.slot];
+    m_live_points -= slot.size;
+    slot.size = 0;
+    ++slot.generation;
+    m_free.push_back(handle.slot);
+    // amortized: a compaction moves the live points, and at least as many were removed since
+    // the last one
+    if (wasted() > m_live_points * sizeof(Point) && wasted() >= (std::size_t{1} << 20)) {
+        compact();
+    }
+    return true;
+}
+
+bool Registry::valid(Handle handle) const
+{
+    return find(handle) != nullptr;
+}
+
+std::size_t Registry::tenants() const
+{
+    return m_slots.size() - m_free.size();
+}
+
+const Registry::Slot * Registry::find(Handle handle) const
+{
+    if (handle.slot >= m_slots.size() || handle.generation % 2 != 0 || m_slots[handle.slot].generation != handle.generation) {
+        return nullptr;
+    }
+    return &m_slots[handle.slot];
+}
+
+bool Registry::bruteForce(const Slot & slot) const
+{
+    return slot.size < m_options.brute_force_below;
+}
+
+void Registry::build(Point * begin, Point * end, std::size_t axis) const
+{
+    if (static_cast<std::size_t>(end - begin) <= m_options.leaf_size) {
+        return;
+    }
+    Point * middle = begin + (end - begin) / 2;
+    std::nth_element(begin, middle, end, [axis](const Point & lhs, const Point & rhs) { return axis == 0 ? lhs.x() < rhs.x() : lhs.y() < rhs.y(); });
+    build(begin, middle, 1 - axis);
+    build(middle + 1, end, 1 - axis);
+}
+
+std::size_t Registry::size(Handle handle) const
+{
+    const Slot * slot = find(handle);
+    return slot == nullptr ? 0 : slot->size;
+}
+
+std::span<const Point> Registry::points(Handle handle) const
+{
+    const Slot * slot = find(handle);
+    if (slot == nullptr) {
+        return {};
+    }
+    return {m_arena.data() + slot->offset, slot->size};
+}
+
+bool Registry::contains(Handle handle, const Point & p) const
+{
+    const Slot * slot = find(handle);
+    if (slot == nullptr) {
+        return false;
+    }
+    auto points = this->points(handle);
+    if (bruteForce(*slot)) {
+        return std::find(points.begin(), points.end(), p) != points.end();
+    }
+    return containsIn<0>(points.data(), points.data() + points.size(), p, m_options.leaf_size);
+}
+
+PointView Registry::range(Handle handle, const Rect & rect) const
+{
+    const Slot * slot = find(handle);
+    if (slot == nullptr) {
+        return {};
+    }
+    auto points = this->points(handle);
+    std::vector<Point> found;
+    if (bruteForce(*slot)) {
+        bool * mask = scratch.maskOf(points.size());
+        found.reserve(kernels::contains(rect, points.data(), points.size(), mask));
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            if (mask[i]) {
+                found.push_back(points[i]);
+            }
+        }
+    }
+    else {
+        rangeIn<0>(points.data(), points.data() + points.size(), rect, m_options.leaf_size, found);
+    }
+    return PointView(std::move(found));
+}
+
+std::optional<Point> Registry::nearest(Handle handle, const Point & p) const
+{
+    PointView found = nearest(handle, p, 1);
+    if (found.empty()) {
+        return std::nullopt;
+    }
+    return found.front();
+}
+
+PointView Registry::nearest(Handle handle, const Point & p, std::size_t k) const
+{
+    const Slot * slot = find(handle);
+    if (slot == nullptr || k == 0) {
+        return {};
+    }
+    auto points = this->points(handle);
+    k = std::min<std::size_t>(k, points.size());
+    std::vector<Point> found;
+    found.reserve(k);
+    if (bruteForce(*slot)) {
+        auto & distances = scratch.distances;
+        distances.resize(points.size());
+        kernels::distances(p, points.data(), points.size(), distances.data());
+        std::vector<std::size_t> order(points.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        auto closer = [&distances](std::size_t lhs, std::size_t rhs) { return distances[lhs] < distances[rhs]; };
+        std::partial_sort(order.begin(), order.begin() + k, order.end(), closer);
+        for (std::size_t i = 0; i < k; ++i) {
+            found.push_back(points[order[i]]);
+        }
+    }
+    else {
+        std::vector<std::pair<double, const Point *>> best;
+        best.reserve(k);
+        nearestIn<0>(points.data(), points.data() + points.size(), p, k, m_options.leaf_size, best);
+        std::sort_heap(best.begin(), best.end());
+        for (const auto & [distance, point] : best) {
+            found.push_back(*point);
+        }
+    }
+    return PointView(std::move(found));
+}
+
+MemoryUsage Registry::memoryUsage(Handle handle) const
+{
+    MemoryUsage usage;
+    if (const Slot * slot = find(handle)) {
+        usage.points = slot->size * sizeof(Point);
+        usage.summaries = sizeof(Slot);
+    }
+    return usage;
+}
+
+MemoryUsage Registry::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.points = m_arena.capacity() * sizeof(Point);
+    usage.summaries = m_slots.capacity() * sizeof(Slot) + m_free.capacity() * sizeof(std::uint32_t);
+    return usage;
+}
+
+std::size_t Registry::wasted() const
+{
+    return (m_arena.size() - m_live_points) * sizeof(Point);
+}
+
+void Registry::compact()
+{
+    std::vector<Point> arena;
+    arena.reserve(m_live_points);
+    for (Slot & slot : m_slots) {
+        auto begin = m_arena.begin() + slot.offset;
+        std::uint64_t offset = arena.size();
+        arena.insert(arena.end(), begin, begin + slot.size);
+        slot.offset = offset;
+    }
+    m_arena = std::move(arena);
+}
+
+} // namespace tenants
@@ -0,0 +1,136 @@
+#include "trace.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+namespace {
+
+struct Event
+{
+    std::uint64_t nanoseconds;
+    const char * name;
+    // Chrome trace phase: 'B' begin, 'E' end, 'i' instant
+    char phase;
+};
+
+// Single-producer ring: the owning thread fills a slot, then publishes it by advancing `head`
+// with a release store; readers copy up to `head` after an acquire load.
+struct Ring
+{
+    std::array<Event, ChromeTrace::ring_capacity> events;
+    std::atomic<std::uint64_t> head{0};
+    std::uint64_t thread_id = 0;
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    // rings stay registered after their thread exits, so its events still get written
+    std::vector<std::shared_ptr<Ring>> rings;
+};
+
+Registry & registry()
+{
+    // never destroyed, since threads may still record after static destruction has begun
+    static Registry * instance = new Registry;
+    return *instance;
+}
+
+Ring & threadRing()
+{
+    thread_local std::shared_ptr<Ring> ring = [] {
+        auto created = std::make_shared<Ring>();
+        Registry & all = registry();
+        std::lock_guard lock(all.mutex);
+        created->thread_id = all.rings.size() + 1;
+        all.rings.push_back(created);
+        return created;
+    }();
+    return *ring;
+}
+
+void record(const char * name, char phase)
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    Ring & ring = threadRing();
+    std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % ChromeTrace::ring_capacity] = {static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), name, phase};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+// writes `text` as a JSON string body
+void escape(std::ostream & out, const char * text)
+{
+    for (; *text != '\0'; ++text) {
+        if (*text == '"' || *text == '\\') {
+            out << '\\';
+        }
+        out << *text;
+    }
+}
+
+} // anonymous namespace
+
+void ChromeTrace::begin(const char * name)
+{
+    record(name, 'B');
+}
+
+void ChromeTrace::end(const char * name)
+{
+    record(name, 'E');
+}
+
+void ChromeTrace::instant(const char * name)
+{
+    record(name, 'i');
+}
+
+bool ChromeTrace::write(const std::string & filename)
+{
+    std::ofstream out(filename);
+    if (!out) {
+        return false;
+    }
+    Registry & all = registry();
+    std::lock_guard lock(all.mutex);
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    for (const auto & ring : all.rings) {
+        std::uint64_t head = ring->head.load(std::memory_order_acquire);
+        std::uint64_t tail = head > ring_capacity ? head - ring_capacity : 0;
+        for (std::uint64_t i = tail; i < head; ++i) {
+            const Event & event = ring->events[i % ring_capacity];
+            out << (first ? "\n" : ",\n") << "{\"name\": \"";
+            escape(out, event.name);
+            out << "\", \"ph\": \"" << event.phase << "\", \"ts\": " << event.nanoseconds / 1000 << "." << event.nanoseconds / 100 % 10
+                << event.nanoseconds / 10 % 10 << event.nanoseconds % 10 << ", \"pid\": 1, \"tid\": " << ring->thread_id;
+            if (event.phase == 'i') {
+                out << ", \"s\": \"t\"";
+            }
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n], \"displayTimeUnit\": \"ns\"}\n";
+    return static_cast<bool>(out);
+}
+
+void ChromeTrace::clear()
+{
+    Registry & all = registry();
+    std::lock_guard lock(all.mutex);
+    for (const auto & ring : all.rings) {
+        ring->head.store(0, std::memory_order_relaxed);
+    }
+}
+
+} // namespace trace
@@ -0,0 +1,299 @@
+#include "vptree.h"
+
+#include "latency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numbers>
+
+namespace vptree {
+
+namespace {
+
+double roundUp(double value)
+{
+    return std::nextafter(value, std::numeric_limits<double>::infinity());
+}
+
+// keeps `best` a max-heap of the k closest (distance, index) pairs
+void offer(std::vector<std::pair<double, std::size_t>> & best, std::size_t k, double d, std::size_t i)
+{
+    if (best.size() == k) {
+        if (d >= best.front().first) {
+            return;
+        }
+        std::pop_heap(best.begin(), best.end());
+        best.pop_back();
+    }
+    best.emplace_back(d, i);
+    std::push_heap(best.begin(), best.end());
+}
+
+} // anonymous namespace
+
+double Euclidean::distance(const Point & lhs, const Point & rhs)
+{
+    return std::sqrt(squaredDistance(lhs, rhs));
+}
+
+double Euclidean::enclosingRadius(const Rect & rect, const Point & centre)
+{
+    // the centre is rounded, so any corner may be the farthest one
+    double result = 0;
+    for (const Point & corner : {Point(rect.xmin(), rect.ymin()), Point(rect.xmin(), rect.ymax()), Point(rect.xmax(), rect.ymin()), Point(rect.xmax(), rect.ymax())}) {
+        result = std::max(result, distance(centre, corner));
+    }
+    return roundUp(result);
+}
+
+double Haversine::distance(const Point & lhs, const Point & rhs)
+{
+    constexpr double to_radians = std::numbers::pi / 180;
+    double lat1 = lhs.y() * to_radians;
+    double lat2 = rhs.y() * to_radians;
+    double sin_lat = std::sin((lat2 - lat1) / 2);
+    double sin_lon = std::sin((rhs.x() - lhs.x()) * to_radians / 2);
+    double h = sin_lat * sin_lat + std::cos(lat1) * std::cos(lat2) * sin_lon * sin_lon;
+    return 2 * earth_radius * std::asin(std::min(1.0, std::sqrt(h)));
+}
+
+double Haversine::enclosingRadius(const Rect & rect, const Point & centre)
+{
+    // within a longitude span of at most 180 degrees the farthest point from the centre is a corner
+    if (rect.xmax() - rect.xmin() > 180) {
+        return std::numbers::pi * earth_radius;
+    }
+    double result = 0;
+    for (const Point & corner : {Point(rect.xmin(), rect.ymin()), Point(rect.xmin(), rect.ymax()), Point(rect.xmax(), rect.ymin()), Point(rect.xmax(), rect.ymax())}) {
+        result = std::max(result, distance(centre, corner));
+    }
+    return roundUp(result);
+}
+
+template <typename Metric>
+PointSet<Metric>::PointSet(const std::string & filename)
+    : PointSet(readPoints(filename))
+{
+}
+
+template <typename Metric>
+PointSet<Metric>::PointSet(std::vector<Point> points)
+    : m_points(uniquePoints(std::move(points)))
+{
+    reBuild();
+}
+
+template <typename Metric>
+void PointSet<Metric>::reBuild()
+{
+    latency::Timer timer(latency::Operation::rebuild);
+    m_indexed = m_points.size();
+    m_radius.assign(m_indexed, 0);
+    buildTree(0, m_indexed);
+}
+
+template <typename Metric>
+std::size_t PointSet<Metric>::middle(std::size_t first, std::size_t last)
+{
+    return first + 1 + (last - first - 1) / 2;
+}
+
+template <typename Metric>
+void PointSet<Metric>::buildTree(std::size_t first, std::size_t last)
+{
+    if (last - first <= leaf_size) {
+        return;
+    }
+    std::swap(m_points[first], m_points[first + (last - first) / 2]);
+    const Point vantage = m_points[first];
+    std::vector<std::pair<double, Point>> by_distance;
+    by_distance.reserve(last - first - 1);
+    for (std::size_t i = first + 1; i < last; ++i) {
+        by_distance.emplace_back(Metric::distance(vantage, m_points[i]), m_points[i]);
+    }
+    std::size_t mid = middle(first, last);
+    auto nth = by_distance.begin() + (mid - first - 1);
+    std::nth_element(by_distance.begin(), nth, by_distance.end(), [](const auto & lhs, const auto & rhs) { return lhs.first < rhs.first; });
+    m_radius[first] = nth->first;
+    for (std::size_t i = 0; i < by_distance.size(); ++i) {
+        m_points[first + 1 + i] = by_distance[i].second;
+    }
+    buildTree(first + 1, mid);
+    buildTree(mid, last);
+}
+
+template <typename Metric>
+bool PointSet<Metric>::empty() const
+{
+    return m_points.empty();
+}
+
+template <typename Metric>
+std::size_t PointSet<Metric>::size() const
+{
+    return m_points.size();
+}
+
+template <typename Metric>
+void PointSet<Metric>::put(const Point & p)
+{
+    if (contains(p)) {
+        return;
+    }
+    m_points.push_back(p);
+    // points outside the indexed part are scanned linearly, so keep that tail short
+    if (m_points.size() - m_indexed > std::max<std::size_t>(16, m_indexed / 8)) {
+        reBuild();
+    }
+}
+
+template <typename Metric>
+bool PointSet<Metric>::contains(const Point & p) const
+{
+    if (std::find(m_points.begin() + m_indexed, m_points.end(), p) != m_points.end()) {
+        return true;
+    }
+    bool found = false;
+    searchRadius(0, m_indexed, p, 0, [&](std::size_t i) { found = found || m_points[i] == p; });
+    return found;
+}
+
+template <typename Metric>
+template <typename Visit>
+void PointSet<Metric>::searchRadius(std::size_t first, std::size_t last, const Point & p, double distance, Visit && visit) const
+{
+    if (last - first <= leaf_size) {
+        for (std::size_t i = first; i < last; ++i) {
+            if (Metric::distance(p, m_points[i]) <= distance) {
+                visit(i);
+            }
+        }
+        return;
+    }
+    double d = Metric::distance(p, m_points[first]);
+    if (d <= distance) {
+        visit(first);
+    }
+    std::size_t mid = middle(first, last);
+    // inside points are at most m_radius from the vantage point, outside ones at least that far
+    if (d - m_radius[first] <= distance) {
+        searchRadius(first + 1, mid, p, distance, visit);
+    }
+    if (m_radius[first] - d <= distance) {
+        searchRadius(mid, last, p, distance, visit);
+    }
+}
+
+template <typename Metric>
+PointView PointSet<Metric>::radius(const Point & p, double distance) const
+{
+    std::vector<Point> found;
+    for (std::size_t i = m_indexed; i < m_points.size(); ++i) {
+        if (Metric::distance(p, m_points[i]) <= distance) {
+            found.push_back(m_points[i]);
+        }
+    }
+    searchRadius(0, m_indexed, p, distance, [&](std::size_t i) { found.push_back(m_points[i]); });
+    return PointView(std::move(found));
+}
+
+template <typename Metric>
+PointView PointSet<Metric>::range(const Rect & rect) const
+{
+    Point centre((rect.xmin() + rect.xmax()) / 2, (rect.ymin() + rect.ymax()) / 2);
+    std::vector<Point> in_rect;
+    for (const auto & p : radius(centre, Metric::enclosingRadius(rect, centre))) {
+        if (rect.contains(p)) {
+            in_rect.push_back(p);
+        }
+    }
+    return PointView(std::move(in_rect));
+}
+
+template <typename Metric>
+typename PointSet<Metric>::iterator PointSet<Metric>::begin() const
+{
+    return m_points.begin();
+}
+
+template <typename Metric>
+typename PointSet<Metric>::iterator PointSet<Metric>::end() const
+{
+    return m_points.end();
+}
+
+template <typename Metric>
+void PointSet<Metric>::searchNearest(std::size_t first, std::size_t last, const Point & p, std::size_t k, std::vector<std::pair<double, std::size_t>> & best) const
+{
+    auto bound = [&] { return best.size() < k ? std::numeric_limits<double>::infinity() : best.front().first; };
+    if (last - first <= leaf_size) {
+        for (std::size_t i = first; i < last; ++i) {
+            offer(best, k, Metric::distance(p, m_points[i]), i);
+        }
+        return;
+    }
+    double d = Metric::distance(p, m_points[first]);
+    offer(best, k, d, first);
+    std::size_t mid = middle(first, last);
+    double split = m_radius[first];
+    // descend into the side the query falls in first, the other one only if the ball around
+    // the query still crosses the split sphere
+    if (d < split) {
+        searchNearest(first + 1, mid, p, k, best);
+        if (split - d < bound()) {
+            searchNearest(mid, last, p, k, best);
+        }
+    }
+    else {
+        searchNearest(mid, last, p, k, best);
+        if (d - split < bound()) {
+            searchNearest(first + 1, mid, p, k, best);
+        }
+    }
+}
+
+template <typename Metric>
+std::vector<std::pair<double, std::size_t>> PointSet<Metric>::nearestIndices(const Point & p, std::size_t k) const
+{
+    std::vector<std::pair<double, std::size_t>> best;
+    best.reserve(k + 1);
+    for (std::size_t i = m_indexed; i < m_points.size(); ++i) {
+        offer(best, k, Metric::distance(p, m_points[i]), i);
+    }
+    searchNearest(0, m_indexed, p, k, best);
+    std::sort_heap(best.begin(), best.end());
+    return best;
+}
+
+template <typename Metric>
+std::optional<Point> PointSet<Metric>::nearest(const Point & p) const
+{
+    if (empty()) {
+        return std::nullopt;
+    }
+    return m_points[nearestIndices(p, 1).front().second];
+}
+
+template <typename Metric>
+PointView PointSet<Metric>::nearest(const Point & p, std::size_t k) const
+{
+    if (k >= size()) {
+        return PointView(std::vector<Point>(begin(), end()));
+    }
+    if (k == 0) {
+        return {};
+    }
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
+    for (const auto & candidate : nearestIndices(p, k)) {
+        neighbours.push_back(m_points[candidate.second]);
+    }
+    return PointView(std::move(neighbours));
+}
+
+template class PointSet<Euclidean>;
+template class PointSet<Haversine>;
+
+} // namespace vptree
@@ -0,0 +1,288 @@
+#include "zorder.h"
+
+#include "latency.h"
+#include "learned.h"
+#include "morton.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+namespace zorder {
+
+namespace {
+
+constexpr double max_cell = 4294967295.0; // 2^32 - 1
+
+} // anonymous namespace
+
+std::size_t BinarySearch::lowerBound(const std::vector<std::uint64_t> & codes, std::uint64_t code, std::size_t first, std::size_t last) const
+{
+    return std::lower_bound(codes.begin() + first, codes.begin() + last, code) - codes.begin();
+}
+
+template <typename Search>
+PointSet<Search>::PointSet(const std::string & filename)
+    : PointSet(readPoints(filename))
+{
+}
+
+template <typename Search>
+PointSet<Search>::PointSet(std::vector<Point> points)
+    : m_points(uniquePoints(std::move(points)))
+{
+    reBuild();
+}
+
+template <typename Search>
+void PointSet<Search>::reBuild()
+{
+    latency::Timer timer(latency::Operation::rebuild);
+    m_indexed = m_points.size();
+    m_codes.clear();
+    if (m_points.empty()) {
+        return;
+    }
+    auto [xmin, xmax] = std::minmax_element(m_points.begin(), m_points.end(), [](const Point & lhs, const Point & rhs) { return lhs.x() < rhs.x(); });
+    auto [ymin, ymax] = std::minmax_element(m_points.begin(), m_points.end(), [](const Point & lhs, const Point & rhs) { return lhs.y() < rhs.y(); });
+    m_xmin = xmin->x();
+    m_xmax = xmax->x();
+    m_ymin = ymin->y();
+    m_ymax = ymax->y();
+    m_xscale = m_xmax > m_xmin ? max_cell / (m_xmax - m_xmin) : 0;
+    m_yscale = m_ymax > m_ymin ? max_cell / (m_ymax - m_ymin) : 0;
+
+    std::vector<std::uint64_t> codes(m_points.size());
+    std::vector<std::size_t> order(m_points.size());
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        codes[i] = code(m_points[i]);
+    }
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&codes](std::size_t lhs, std::size_t rhs) { return codes[lhs] < codes[rhs]; });
+    std::vector<Point> sorted;
+    sorted.reserve(m_points.size());
+    m_codes.reserve(m_points.size());
+    for (std::size_t i : order) {
+        sorted.push_back(m_points[i]);
+        m_codes.push_back(codes[i]);
+    }
+    m_points = std::move(sorted);
+    m_search.build(m_codes);
+}
+
+template <typename Search>
+std::size_t PointSet<Search>::lowerBound(std::uint64_t code, std::size_t first, std::size_t last) const
+{
+    return m_search.lowerBound(m_codes, code, first, last);
+}
+
+template <typename Search>
+std::size_t PointSet<Search>::upperBound(std::uint64_t code, std::size_t first, std::size_t last) const
+{
+    return code == std::numeric_limits<std::uint64_t>::max() ? last : lowerBound(code + 1, first, last);
+}
+
+template <typename Search>
+std::uint32_t PointSet<Search>::quantizeX(double x) const
+{
+    return static_cast<std::uint32_t>(std::clamp(std::floor((x - m_xmin) * m_xscale), 0.0, max_cell));
+}
+
+template <typename Search>
+std::uint32_t PointSet<Search>::quantizeY(double y) const
+{
+    return static_cast<std::uint32_t>(std::clamp(std::floor((y - m_ymin) * m_yscale), 0.0, max_cell));
+}
+
+template <typename Search>
+std::uint64_t PointSet<Search>::code(const Point & p) const
+{
+    return morton::encode(quantizeX(p.x()), quantizeY(p.y()));
+}
+
+template <typename Search>
+std::optional<typename PointSet<Search>::Box> PointSet<Search>::quantize(const Rect & rect) const
+{
+    if (m_indexed == 0 || rect.xmax() < m_xmin || rect.xmin() > m_xmax || rect.ymax() < m_ymin || rect.ymin() > m_ymax) {
+        return std::nullopt;
+    }
+    return Box{quantizeX(rect.xmin()), quantizeY(rect.ymin()), quantizeX(rect.xmax()), quantizeY(rect.ymax())};
+}
+
+template <typename Search>
+template <typename Visit>
+void PointSet<Search>::intervals(const Box & box, std::size_t first, std::size_t last, Visit && visit) const
+{
+    std::uint64_t zmin = morton::encode(box.x0, box.y0);
+    std::uint64_t zmax = morton::encode(box.x1, box.y1);
+    first = lowerBound(zmin, first, last);
+    last = upperBound(zmax, first, last);
+    if (first == last) {
+        return;
+    }
+    // the interval holds no codes outside the box exactly when it is as long as the box area
+    // (both sides wrap to 0 for the full 2^32 x 2^32 box)
+    std::uint64_t area = std::uint64_t{box.x1 - box.x0 + 1} * (box.y1 - box.y0 + 1);
+    if (zmax - zmin + 1 == area || last - first <= scan_threshold) {
+        visit(first, last);
+        return;
+    }
+    // split at the highest bit where zmin and zmax differ: LITMAX ends the lower half,
+    // BIGMIN starts the upper one
+    unsigned bit = 63 - std::countl_zero(zmin ^ zmax);
+    unsigned shift = bit / 2;
+    if (bit % 2 == 0) {
+        std::uint32_t split = (box.x1 >> shift) << shift;
+        intervals(Box{box.x0, box.y0, split - 1, box.y1}, first, last, visit);
+        intervals(Box{split, box.y0, box.x1, box.y1}, first, last, visit);
+    }
+    else {
+        std::uint32_t split = (box.y1 >> shift) << shift;
+        intervals(Box{box.x0, box.y0, box.x1, split - 1}, first, last, visit);
+        intervals(Box{box.x0, split, box.x1, box.y1}, first, last, visit);
+    }
+}
+
+template <typename Search>
+bool PointSet<Search>::empty() const
+{
+    return m_points.empty();
+}
+
+template <typename Search>
+std::size_t PointSet<Search>::size() const
+{
+    return m_points.size();
+}
+
+template <typename Search>
+void PointSet<Search>::put(const Point & p)
+{
+    if (contains(p)) {
+        return;
+    }
+    m_points.push_back(p);
+    // points outside the indexed part are scanned linearly, so keep that tail short
+    if (m_points.size() - m_indexed > std::max<std::size_t>(16, m_indexed / 8)) {
+        reBuild();
+    }
+}
+
+template <typename Search>
+bool PointSet<Search>::contains(const Point & p) const
+{
+    if (std::find(m_points.begin() + m_indexed, m_points.end(), p) != m_points.end()) {
+        return true;
+    }
+    if (m_indexed == 0) {
+        return false;
+    }
+    std::uint64_t c = code(p);
+    std::size_t first = lowerBound(c, 0, m_indexed);
+    auto points_first = m_points.begin() + first;
+    auto points_last = m_points.begin() + upperBound(c, first, m_indexed);
+    return std::find(points_first, points_last, p) != points_last;
+}
+
+template <typename Search>
+PointView PointSet<Search>::range(const Rect & rect) const
+{
+    std::vector<Point> in_rect;
+    auto collect = [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+            if (rect.contains(m_points[i])) {
+                in_rect.push_back(m_points[i]);
+            }
+        }
+    };
+    collect(m_indexed, m_points.size());
+    if (auto box = quantize(rect)) {
+        intervals(*box, 0, m_indexed, collect);
+    }
+    return PointView(std::move(in_rect));
+}
+
+template <typename Search>
+typename PointSet<Search>::iterator PointSet<Search>::begin() const
+{
+    return m_points.begin();
+}
+
+template <typename Search>
+typename PointSet<Search>::iterator PointSet<Search>::end() const
+{
+    return m_points.end();
+}
+
+template <typename Search>
+std::optional<Point> PointSet<Search>::nearest(const Point & point) const
+{
+    if (empty()) {
+        return std::nullopt;
+    }
+    return nearest(point, 1).front();
+}
+
+template <typename Search>
+PointView PointSet<Search>::nearest(const Point & point, std::size_t k) const
+{
+    if (k >= size()) {
+        return PointView(std::vector<Point>(begin(), end()));
+    }
+    if (k == 0) {
+        return {};
+    }
+    // max-heap of (squared distance, index) holding the best k candidates seen so far
+    std::vector<std::pair<double, std::size_t>> best;
+    best.reserve(k + 1);
+    auto offer = [&](std::size_t i) {
+        double dist = squaredDistance(m_points[i], point);
+        if (best.size() == k) {
+            if (dist >= best.front().first) {
+                return;
+            }
+            std::pop_heap(best.begin(), best.end());
+            best.pop_back();
+        }
+        best.emplace_back(dist, i);
+        std::push_heap(best.begin(), best.end());
+    };
+    for (std::size_t i = m_indexed; i < m_points.size(); ++i) {
+        offer(i);
+    }
+    // the curve neighbours of the query give an upper bound for the k-th distance,
+    // then a box of that radius is searched exactly
+    std::size_t at = lowerBound(code(point), 0, m_indexed);
+    std::size_t window_first = at - std::min(at, k);
+    std::size_t window_last = std::min(m_indexed, window_first + 2 * k);
+    window_first = window_last - std::min(window_last, 2 * k);
+    for (std::size_t i = window_first; i < window_last; ++i) {
+        offer(i);
+    }
+    double radius = std::nextafter(std::sqrt(best.front().first), std::numeric_limits<double>::infinity());
+    Rect around({point.x() - radius, point.y() - radius}, {point.x() + radius, point.y() + radius});
+    if (auto box = quantize(around)) {
+        intervals(*box, 0, m_indexed, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+                if (i < window_first || i >= window_last) {
+                    offer(i);
+                }
+            }
+        });
+    }
+    std::sort_heap(best.begin(), best.end());
+    std::vector<Point> neighbours;
+    neighbours.reserve(k);
+    for (const auto & candidate : best) {
+        neighbours.push_back(m_points[candidate.second]);
+    }
+    return PointView(std::move(neighbours));
+}
+
+template class PointSet<BinarySearch>;
+template class PointSet<learned::Model>;
+
+} // namespace zorder